@@ -0,0 +1,475 @@
+/*
+	accuracy.c
+
+	accuracy against speed of every kernel path. each path is forced in turn with
+	swsContextCreateForced() and measured against an exact reference: every test
+	signal is band limited and defined in continuous time, so the ideal resampler's
+	output is the same function at the output instants, evaluated in double.
+
+	muragami, muragami@wishray.com, Jason A. Petrasko 2024
+	MIT license: https://opensource.org/license/mit/
+*/
+
+#include "accuracy.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+// test signals are this long, the edges are left out of every measurement so no
+// filter (or cascade of them) still reaches past the start or end of the input
+#define ACC_SECONDS			0.5
+#define ACC_EDGE			0.1
+#define ACC_AMPLITUDE		0.5
+#define ACC_TONE			997.0
+#define ACC_RIPPLE_TONES	24
+#define ACC_STOP_TONES		12
+// the band limited pulse, a kaiser windowed sinc this many seconds either side
+#define ACC_PULSE_HALF		0.02
+#define ACC_PULSE_BETA		14.0
+
+#define ACC_TONE_SIGNAL		0
+#define ACC_SWEEP_SIGNAL	1
+#define ACC_PULSE_SIGNAL	2
+
+typedef struct _accVariant {
+	const char *name;
+	int32_t force;
+	int32_t bits;
+	// a swsdsp.h level, or -1 for a kernel path
+	int32_t level;
+} accVariant;
+
+// path variants that end up on the same kernels as auto are left out, the first of
+// each input format is what that format gets by default
+static const accVariant accVariants[] = {
+	{ "auto", 0, 32, -1 },
+	{ "single", SWS_FORCE_SINGLE, 32, -1 },
+	{ "direct", SWS_FORCE_DIRECT, 32, -1 },
+	{ "lut32", SWS_FORCE_LUT | SWS_FORCE_LUT32, 32, -1 },
+	{ "lut16", SWS_FORCE_LUT | SWS_FORCE_LUT16, 32, -1 },
+	{ "auto s16", 0, 16, -1 },
+	{ "float s16", SWS_FORCE_FLOAT, 16, -1 },
+	{ "fixed s16", SWS_FORCE_FIXED, 16, -1 },
+	{ "scalar", SWS_FORCE_DSP(SWS_DSP_SCALAR), 32, SWS_DSP_SCALAR },
+	{ "sse2", SWS_FORCE_DSP(SWS_DSP_SSE2), 32, SWS_DSP_SSE2 },
+	{ "avx2", SWS_FORCE_DSP(SWS_DSP_AVX2), 32, SWS_DSP_AVX2 },
+	{ "avx512", SWS_FORCE_DSP(SWS_DSP_AVX512), 32, SWS_DSP_AVX512 },
+};
+
+#define ACC_VARIANTS		(int32_t)(sizeof(accVariants) / sizeof(accVariant))
+
+static const char *accQualityNames[] = { "draft", "voice", "broadcast", "mastering" };
+
+typedef struct _accResult {
+	int32_t inFreq;
+	int32_t outFreq;
+	int32_t preset;
+	int32_t variant;
+	double snr;
+	double thdn;
+	double sweepSnr;
+	double pulseSnr;
+	double ripple;
+	double stopband;
+	double nsPerFrame;
+	double realtime;
+	int32_t pareto;
+} accResult;
+
+// the band a rate pair keeps, as the resampler designs it: pass to stop are the
+// edges of the transition, the middle of it sits half a transition below the output
+// rate's nyquist, or at the input's when upsampling
+typedef struct _accBand {
+	double pass;
+	double stop;
+} accBand;
+
+static void accBandOf(accBand *b, int32_t inFreq, int32_t outFreq, const swsQuality *q) {
+	double tw = (outFreq > inFreq) ? q->upTransition : q->downTransition;
+	double cutoff2 = outFreq - tw * inFreq * 0.5;
+
+	if (cutoff2 > inFreq)
+		cutoff2 = inFreq;
+	b->pass = cutoff2 * 0.5 - tw * inFreq * 0.25;
+	b->stop = cutoff2 * 0.5 + tw * inFreq * 0.25;
+}
+
+static double accI0(double x) {
+	double sum = 1.0, term = 1.0;
+
+	for (int32_t k = 1; k < 64; k++)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+static double accKaiser(double x, double beta) {
+	if (x <= -1.0 || x >= 1.0)
+		return 0.0;
+	return accI0(beta * sqrt(1.0 - x * x)) / accI0(beta);
+}
+
+// the test signal at time t, param is the tone frequency or the top of the sweep
+// or pulse band
+static double accSignal(int32_t kind, double param, double t) {
+	switch (kind) {
+		case ACC_SWEEP_SIGNAL: {
+			// 20 Hz up to param, faded in and out over 20 ms so the ends don't splatter
+			double k = log(param / 20.0);
+			double v = ACC_AMPLITUDE * sin(2.0 * M_PI * 20.0 * ACC_SECONDS / k * (exp(t / ACC_SECONDS * k) - 1.0));
+			double fade = 0.02;
+
+			if (t < fade)
+				v *= 0.5 - 0.5 * cos(M_PI * t / fade);
+			else if (t > ACC_SECONDS - fade)
+				v *= 0.5 - 0.5 * cos(M_PI * (ACC_SECONDS - t) / fade);
+			return v;
+		}
+		case ACC_PULSE_SIGNAL: {
+			double x = t - ACC_SECONDS * 0.5;
+
+			if (fabs(x) < 1e-12)
+				return ACC_AMPLITUDE;
+			return ACC_AMPLITUDE * sin(2.0 * M_PI * param * x) / (2.0 * M_PI * param * x) * accKaiser(x / ACC_PULSE_HALF, ACC_PULSE_BETA);
+		}
+		default:
+			return ACC_AMPLITUDE * sin(2.0 * M_PI * param * t + 0.3);
+	}
+}
+
+// the signal sampled at inFreq, in the variant's input format
+static void accInput(wavSound *snd, int32_t kind, double param, int32_t inFreq, int32_t bits) {
+	wavSound f;
+	int64_t frames = (int64_t)(ACC_SECONDS * inFreq);
+	float *d;
+
+	f.channels = 1;
+	f.sampleRate = inFreq;
+	f.bitsPerSample = 32;
+	f.data.numBytes = frames * sizeof(float);
+	f.data.bytes = malloc(f.data.numBytes);
+	if (f.data.bytes == NULL)
+		wavFatal("accInput() allocation failure");
+	d = (float*)f.data.bytes;
+	for (int64_t i = 0; i < frames; i++)
+		d[i] = (float)accSignal(kind, param, (double)i / inFreq);
+	if (bits == 32) {
+		*snd = f;
+		return;
+	}
+	swsConvertSnd(&f, snd, bits, NULL);
+	free(f.data.bytes);
+}
+
+// resampled and back to float whatever the format, the caller frees the samples
+static float* accResample(const swsContext *ctx, wavSound *in, int64_t *frames) {
+	wavSound out;
+	wavSound f;
+
+	swsResampleSnd(ctx, in, &out, NULL);
+	if (out.bitsPerSample != 32) {
+		swsConvertSnd(&out, &f, 32, NULL);
+		free(out.data.bytes);
+		out = f;
+	}
+	*frames = out.data.numBytes / sizeof(float);
+	return (float*)out.data.bytes;
+}
+
+static float* accRun(const swsContext *ctx, int32_t inFreq, int32_t kind, double param, int32_t bits, int64_t *frames) {
+	wavSound in;
+	float *y;
+
+	accInput(&in, kind, param, inFreq, bits);
+	y = accResample(ctx, &in, frames);
+	free(in.data.bytes);
+	return y;
+}
+
+// y ~ a sin + b cos at f over n0 to n1 by least squares
+static void accFitSinCos(const float *y, int64_t n0, int64_t n1, double f, int32_t rate, double *a, double *b) {
+	double ss = 0.0, sc = 0.0, cc = 0.0, ys = 0.0, yc = 0.0, det;
+
+	for (int64_t i = n0; i < n1; i++)
+	{
+		double s = sin(2.0 * M_PI * f * i / rate), c = cos(2.0 * M_PI * f * i / rate);
+
+		ss += s * s;
+		sc += s * c;
+		cc += c * c;
+		ys += y[i] * s;
+		yc += y[i] * c;
+	}
+	det = ss * cc - sc * sc;
+	*a = (ys * cc - yc * sc) / det;
+	*b = (yc * ss - ys * sc) / det;
+}
+
+// the amplitude at f, with the energy of what is left in *residual if that is set
+static double accFit(const float *y, int64_t n0, int64_t n1, double f, int32_t rate, double *residual) {
+	double a, b;
+
+	accFitSinCos(y, n0, n1, f, rate, &a, &b);
+	if (residual != NULL) {
+		*residual = 0.0;
+		for (int64_t i = n0; i < n1; i++)
+		{
+			double e = y[i] - a * sin(2.0 * M_PI * f * i / rate) - b * cos(2.0 * M_PI * f * i / rate);
+
+			*residual += e * e;
+		}
+	}
+	return sqrt(a * a + b * b);
+}
+
+// takes the tone at f out of y, so its leakage doesn't swamp a far weaker one
+static void accRemove(float *y, int64_t n0, int64_t n1, double f, int32_t rate) {
+	double a, b;
+
+	accFitSinCos(y, n0, n1, f, rate, &a, &b);
+	for (int64_t i = n0; i < n1; i++)
+		y[i] -= a * sin(2.0 * M_PI * f * i / rate) + b * cos(2.0 * M_PI * f * i / rate);
+}
+
+// against the exact output, in dB
+static double accSnr(const float *y, int64_t n0, int64_t n1, int32_t kind, double param, int32_t rate) {
+	double sig = 0.0, err = 0.0;
+
+	for (int64_t i = n0; i < n1; i++)
+	{
+		double r = accSignal(kind, param, (double)i / rate);
+
+		sig += r * r;
+		err += (y[i] - r) * (y[i] - r);
+	}
+	return 10.0 * log10(sig / (err + 1e-30));
+}
+
+static void accMeasure(accResult *r, const swsContext *ctx, const float *tone, int64_t toneFrames, const accBand *band,
+						int32_t bits, int32_t threads, double minTime) {
+	const int32_t inFreq = r->inFreq, outFreq = r->outFreq;
+	int64_t n0 = (int64_t)(ACC_EDGE * outFreq), n1 = (int64_t)((ACC_SECONDS - ACC_EDGE) * outFreq);
+	int64_t frames, outFrames;
+	double amp, res, lo = 1e30, hi = -1e30, worst = -1.0;
+	wavSound in;
+	float *y;
+	int32_t i;
+
+	if (n1 > toneFrames)
+		n1 = toneFrames;
+
+	// a tone near 1 kHz against the exact tone, then what is left once it is fitted
+	r->snr = accSnr(tone, n0, n1, ACC_TONE_SIGNAL, ACC_TONE, outFreq);
+	amp = accFit(tone, n0, n1, ACC_TONE, outFreq, &res);
+	r->thdn = 10.0 * log10((res + 1e-30) / (amp * amp * 0.5 * (n1 - n0)));
+
+	// a sweep and a pulse over most of the passband
+	y = accRun(ctx, inFreq, ACC_SWEEP_SIGNAL, band->pass * 0.9, bits, &frames);
+	r->sweepSnr = accSnr(y, n0, n1 < frames ? n1 : frames, ACC_SWEEP_SIGNAL, band->pass * 0.9, outFreq);
+	free(y);
+	y = accRun(ctx, inFreq, ACC_PULSE_SIGNAL, band->pass * 0.85, bits, &frames);
+	r->pulseSnr = accSnr(y, (int64_t)((ACC_SECONDS * 0.5 - ACC_PULSE_HALF) * outFreq),
+						(int64_t)((ACC_SECONDS * 0.5 + ACC_PULSE_HALF) * outFreq), ACC_PULSE_SIGNAL, band->pass * 0.85, outFreq);
+	free(y);
+
+	// peak to peak gain over tones across the passband
+	for (i = 0; i < ACC_RIPPLE_TONES; i++)
+	{
+		double f = band->pass * (i + 0.5) / ACC_RIPPLE_TONES, g;
+
+		y = accRun(ctx, inFreq, ACC_TONE_SIGNAL, f, bits, &frames);
+		g = 20.0 * log10(accFit(y, n0, n1 < frames ? n1 : frames, f, outFreq, NULL) / ACC_AMPLITUDE);
+		free(y);
+		if (g < lo) lo = g;
+		if (g > hi) hi = g;
+	}
+	r->ripple = hi - lo;
+
+	// the worst alias of a tone above the stopband edge, or the worst images of a
+	// passband tone, relative to the tone. a wide transition can leave no image below
+	// the output's nyquist at all, that is NAN.
+	for (i = 0; i < ACC_STOP_TONES; i++)
+	{
+		double level = -1.0, f;
+
+		if (outFreq < inFreq) {
+			f = band->stop + (inFreq * 0.5 - band->stop) * (i + 0.5) / ACC_STOP_TONES;
+			y = accRun(ctx, inFreq, ACC_TONE_SIGNAL, f, bits, &frames);
+			amp = accFit(y, n0, n1 < frames ? n1 : frames, fabs(f - outFreq * floor(f / outFreq + 0.5)), outFreq, NULL);
+			level = amp * amp;
+		} else {
+			f = band->pass * (i + 0.5) / ACC_STOP_TONES;
+			y = accRun(ctx, inFreq, ACC_TONE_SIGNAL, f, bits, &frames);
+			accRemove(y, n0, n1 < frames ? n1 : frames, f, outFreq);
+			for (int32_t k = 1; k * inFreq - f < outFreq * 0.5; k++)
+			{
+				amp = accFit(y, n0, n1 < frames ? n1 : frames, k * inFreq - f, outFreq, NULL);
+				level = (level < 0.0 ? 0.0 : level) + amp * amp;
+				if (k * inFreq + f < outFreq * 0.5) {
+					amp = accFit(y, n0, n1 < frames ? n1 : frames, k * inFreq + f, outFreq, NULL);
+					level += amp * amp;
+				}
+			}
+		}
+		free(y);
+		if (level > worst)
+			worst = level;
+	}
+	r->stopband = (worst < 0.0) ? NAN : 10.0 * log10((worst + 1e-30) / (ACC_AMPLITUDE * ACC_AMPLITUDE));
+
+	accInput(&in, ACC_TONE_SIGNAL, ACC_TONE, inFreq, bits);
+	r->realtime = ACC_SECONDS / timeResample(ctx, &in, threads, minTime, &outFrames);
+	r->nsPerFrame = 1e9 * ACC_SECONDS / r->realtime / outFrames;
+	free(in.data.bytes);
+}
+
+// the lowest of the dB figures, what a spec would be checked against
+static double accWorst(const accResult *r) {
+	double w = r->snr;
+
+	if (r->sweepSnr < w) w = r->sweepSnr;
+	if (r->pulseSnr < w) w = r->pulseSnr;
+	if (!isnan(r->stopband) && -r->stopband < w) w = -r->stopband;
+	return w;
+}
+
+// nothing else on the same rate pair is both at least as fast and at least as good
+static void accPareto(accResult *r, int32_t count) {
+	for (int32_t i = 0; i < count; i++)
+	{
+		r[i].pareto = 1;
+		for (int32_t j = 0; j < count && r[i].pareto; j++)
+		{
+			if (j != i && r[j].realtime >= r[i].realtime && accWorst(&r[j]) >= accWorst(&r[i])
+				&& (r[j].realtime > r[i].realtime || accWorst(&r[j]) > accWorst(&r[i])))
+				r[i].pareto = 0;
+		}
+	}
+}
+
+// a figure for the JSON, null for NAN
+static const char* accNumber(char *buf, double v) {
+	if (isnan(v))
+		return "null";
+	sprintf(buf, "%.2f", v);
+	return buf;
+}
+
+static void accWriteJson(FILE *f, const accResult *r, int32_t count, int32_t threads) {
+	char stop[32];
+
+	fprintf(f, "{\n");
+	fprintf(f, "\t\"dsp\": \"%s\",\n", swsDspBest()->name);
+	fprintf(f, "\t\"threads\": %d,\n", threads);
+	fprintf(f, "\t\"results\": [\n");
+	for (int32_t i = 0; i < count; i++)
+		fprintf(f, "\t\t{\"in\": %d, \"out\": %d, \"quality\": \"%s\", \"variant\": \"%s\", \"snr_db\": %.2f, "
+				"\"thdn_db\": %.2f, \"sweep_snr_db\": %.2f, \"pulse_snr_db\": %.2f, \"ripple_db\": %.5f, "
+				"\"stopband_db\": %s, \"ns_per_frame\": %.3f, \"x_realtime\": %.2f, \"pareto\": %s}%s\n",
+				r[i].inFreq, r[i].outFreq, accQualityNames[r[i].preset], accVariants[r[i].variant].name, r[i].snr,
+				r[i].thdn, r[i].sweepSnr, r[i].pulseSnr, r[i].ripple, accNumber(stop, r[i].stopband), r[i].nsPerFrame, r[i].realtime,
+				r[i].pareto ? "true" : "false", (i + 1 < count) ? "," : "");
+	fprintf(f, "\t]\n}\n");
+}
+
+int accuracyRun(const int32_t *rates, int32_t numRates, int32_t presets, int32_t threads, double minTime,
+				const char *jsonName) {
+	FILE *table = (jsonName != NULL && !strcmp(jsonName, "-")) ? stderr : stdout;
+	accResult *results = malloc(sizeof(accResult) * numRates * numRates * 4 * ACC_VARIANTS);
+	int32_t count = 0;
+
+	if (results == NULL)
+		wavFatal("accuracyRun() allocation failure");
+	fprintf(table, "dsp %s, %d thread(s), * is on the speed / worst dB pareto front of its rate pair\n",
+			swsDspBest()->name, threads);
+	for (int32_t i = 0; i < numRates; i++)
+	{
+		for (int32_t o = 0; o < numRates; o++)
+		{
+			int32_t first = count;
+
+			if (rates[i] == rates[o] || rates[i] < 8000 || rates[o] < 8000)
+				continue;
+			for (int32_t p = 0; p < 4; p++)
+			{
+				// the default tone output of each input format, to spot forced paths that
+				// are the default anyway
+				float *base[2] = { NULL, NULL };
+				int64_t baseFrames[2] = { 0, 0 };
+				swsQuality q;
+				accBand band;
+
+				if (!(presets & (1 << p)))
+					continue;
+				swsQualityPreset(&q, p);
+				accBandOf(&band, rates[i], rates[o], &q);
+				for (int32_t v = 0; v < ACC_VARIANTS; v++)
+				{
+					const accVariant *av = &accVariants[v];
+					int32_t b = av->bits == 16;
+					swsContext *ctx;
+					accResult *r;
+					float *tone;
+					int64_t frames;
+
+					if (av->level >= 0 && swsDspLevel(av->level) == NULL)
+						continue;
+					ctx = swsContextCreateForced(rates[i], rates[o], &q, av->force);
+					tone = accRun(ctx, rates[i], ACC_TONE_SIGNAL, ACC_TONE, av->bits, &frames);
+					if (av->level < 0 && base[b] != NULL && frames == baseFrames[b]
+						&& !memcmp(tone, base[b], frames * sizeof(float))) {
+						free(tone);
+						swsContextFree(ctx);
+						continue;
+					}
+					r = &results[count++];
+					r->inFreq = rates[i];
+					r->outFreq = rates[o];
+					r->preset = p;
+					r->variant = v;
+					accMeasure(r, ctx, tone, frames, &band, av->bits, threads, minTime);
+					swsContextFree(ctx);
+					if (av->level < 0 && base[b] == NULL) {
+						base[b] = tone;
+						baseFrames[b] = frames;
+					} else
+						free(tone);
+				}
+				free(base[0]);
+				free(base[1]);
+			}
+
+			accPareto(results + first, count - first);
+			fprintf(table, "\n%d -> %d\n", rates[i], rates[o]);
+			fprintf(table, "%-10s %-10s %7s %8s %7s %7s %8s %9s %10s\n", "quality", "variant", "snr", "thd+n",
+					"sweep", "pulse", "ripple", "stopband", "x realtime");
+			for (int32_t k = first; k < count; k++)
+			{
+				const accResult *r = &results[k];
+
+				fprintf(table, "%-10s %-10s %7.1f %8.1f %7.1f %7.1f %8.4f %9.1f %10.1f %s\n",
+						accQualityNames[r->preset], accVariants[r->variant].name, r->snr, r->thdn, r->sweepSnr,
+						r->pulseSnr, r->ripple, r->stopband, r->realtime, r->pareto ? "*" : "");
+			}
+			fflush(table);
+		}
+	}
+
+	if (jsonName != NULL) {
+		FILE *f = strcmp(jsonName, "-") ? fopen(jsonName, "w") : stdout;
+
+		if (f == NULL) {
+			printf("can't write '%s'\n", jsonName);
+			free(results);
+			return -1;
+		}
+		accWriteJson(f, results, count, threads);
+		if (f != stdout)
+			fclose(f);
+	}
+	free(results);
+	return 0;
+}
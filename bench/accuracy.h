@@ -0,0 +1,20 @@
+/*
+	accuracy.h
+
+	header accuracy against speed of every kernel path
+
+	muragami, muragami@wishray.com, Jason A. Petrasko 2024
+	MIT license: https://opensource.org/license/mit/
+*/
+
+#ifndef ACCURACY_H
+#define ACCURACY_H
+
+#include "bench.h"
+
+// every kernel path at each quality preset (presets is a bit per SWS_QUALITY_*) on
+// every ordered pair of rates, printed as a table per pair and optionally as JSON
+int accuracyRun(const int32_t *rates, int32_t numRates, int32_t presets, int32_t threads, double minTime,
+				const char *jsonName);
+
+#endif
@@ -0,0 +1,303 @@
+/*
+	bench.c
+
+	resampler benchmark, sweeps rate pairs, channel counts and sample formats over
+	synthetic signals and reports ns per output frame, x realtime and the time to
+	design each context's filter tables, as a table and optionally as JSON
+
+	muragami, muragami@wishray.com, Jason A. Petrasko 2024
+	MIT license: https://opensource.org/license/mit/
+*/
+
+#include "bench.h"
+#include "accuracy.h"
+#include "verify.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+double getTime(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec * 0.000000001;
+}
+
+static int32_t parseList(int32_t *list, const char *s) {
+	int32_t n = 0;
+
+	while (*s && n < BENCH_MAX_LIST) {
+		list[n++] = atoi(s);
+		while (*s && *s != ',') s++;
+		if (*s == ',') s++;
+	}
+	return n;
+}
+
+static const char* formatName(int32_t bits) {
+	switch (bits) {
+		case 8: return "u8";
+		case 16: return "s16";
+		case WAV_S24: return "s24";
+		case WAV_S32: return "s32";
+		default: return "f32";
+	}
+}
+
+// a tone a little different on every channel, a log sweep over the whole band and a
+// little noise, so every part of the filter does some work. deterministic, every run
+// and every host gets the same samples.
+void makeSignal(wavSound *snd, int32_t freq, int32_t channels, int32_t bits, double seconds) {
+	wavSound f;
+	int64_t frames = (int64_t)(seconds * freq);
+	float *d;
+	uint32_t seed = 0x9e3779b9;
+
+	f.channels = channels;
+	f.sampleRate = freq;
+	f.bitsPerSample = 32;
+	f.data.numBytes = frames * channels * sizeof(float);
+	f.data.bytes = malloc(f.data.numBytes);
+	if (f.data.bytes == NULL)
+		wavFatal("makeSignal() allocation failure");
+	d = (float*)f.data.bytes;
+	for (int64_t i = 0; i < frames; i++)
+	{
+		double t = (double)i / freq;
+		double sweep = 0.3 * sin(2.0 * M_PI * 20.0 * seconds / log(freq / 40.0) * (exp(t / seconds * log(freq / 40.0)) - 1.0));
+
+		for (int32_t c = 0; c < channels; c++)
+		{
+			seed = seed * 1664525 + 1013904223;
+			d[i * channels + c] = (float)(0.4 * sin(2.0 * M_PI * 440.0 * (1.0 + 0.37 * c) * t) + sweep
+									+ 0.01 * ((double)(seed >> 8) / 8388608.0 - 1.0));
+		}
+	}
+	if (bits == 32) {
+		*snd = f;
+		return;
+	}
+	swsConvertSnd(&f, snd, bits, NULL);
+	free(f.data.bytes);
+}
+
+double timeResample(const swsContext *ctx, wavSound *in, int32_t threads, double minTime, int64_t *outFrames) {
+	wavSound out;
+	double best = 1e30;
+	double spent = 0.0;
+
+	for (int32_t run = 0; run < 2 || spent < minTime; run++)
+	{
+		double start = getTime();
+		double t;
+
+		swsResampleSndMT(ctx, in, &out, threads, NULL);
+		t = getTime() - start;
+		spent += t;
+		if (t < best)
+			best = t;
+		*outFrames = out.data.numBytes / (out.channels * WAV_DATA_BYTES(out.bitsPerSample));
+		free(out.data.bytes);
+	}
+	return best;
+}
+
+// designed from scratch every time, the cache is never set here
+static swsContext* buildContext(int32_t inFreq, int32_t outFreq, const swsQuality *q, double *lutMs) {
+	swsContext *ctx = NULL;
+	double best = 1e30;
+
+	for (int32_t i = 0; i < 3; i++)
+	{
+		double start = getTime();
+		double t;
+
+		if (ctx != NULL)
+			swsContextFree(ctx);
+		ctx = swsContextCreate(inFreq, outFreq, q);
+		t = getTime() - start;
+		if (t < best)
+			best = t;
+	}
+	*lutMs = best * 1000.0;
+	return ctx;
+}
+
+static void writeJson(FILE *f, const benchResult *r, int32_t count, const char *quality, int32_t threads,
+						double seconds) {
+	fprintf(f, "{\n");
+	fprintf(f, "\t\"dsp\": \"%s\",\n", swsDspBest()->name);
+	fprintf(f, "\t\"quality\": \"%s\",\n", quality);
+	fprintf(f, "\t\"threads\": %d,\n", threads);
+	fprintf(f, "\t\"seconds\": %g,\n", seconds);
+	fprintf(f, "\t\"results\": [\n");
+	for (int32_t i = 0; i < count; i++)
+		fprintf(f, "\t\t{\"in\": %d, \"out\": %d, \"channels\": %d, \"format\": \"%s\", \"frames\": %lld, "
+				"\"ns_per_frame\": %.3f, \"x_realtime\": %.2f, \"lut_ms\": %.4f}%s\n",
+				r[i].inFreq, r[i].outFreq, r[i].channels, formatName(r[i].bits), (long long)r[i].outFrames,
+				r[i].nsPerFrame, r[i].realtime, r[i].lutMs, (i + 1 < count) ? "," : "");
+	fprintf(f, "\t]\n}\n");
+}
+
+int main(int argc, const char **argv) {
+	int32_t rates[BENCH_MAX_LIST] = { 8000, 16000, 22050, 44100, 48000, 96000, 192000 };
+	int32_t chans[BENCH_MAX_LIST] = { 1, 2, 6, 8, 16 };
+	int32_t bits[BENCH_MAX_LIST] = { 8, 16, 24, 32 };
+	int32_t numRates = 7;
+	int32_t numChans = 5;
+	int32_t numBits = 4;
+	int32_t accuracy = 0;
+	int32_t verify = 0;
+	int32_t ratesSet = 0;
+	int32_t presets = 0;
+	int32_t threads = 1;
+	double seconds = 1.0;
+	double minTime = 0.05;
+	const char *qualityName = "mastering";
+	const char *jsonName = NULL;
+	benchResult *results;
+	int32_t count = 0;
+	swsQuality quality;
+	FILE *table = stdout;
+
+	swsQualityPreset(&quality, SWS_QUALITY_MASTERING);
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+			numRates = parseList(rates, argv[++i]);
+			ratesSet = 1;
+		} else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+			numChans = parseList(chans, argv[++i]);
+		} else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+			numBits = parseList(bits, argv[++i]);
+		} else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+			seconds = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+			minTime = atof(argv[++i]) / 1000.0;
+		} else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+			jsonName = argv[++i];
+		} else if (!strcmp(argv[i], "-a")) {
+			accuracy = 1;
+		} else if (!strcmp(argv[i], "-v")) {
+			verify = 1;
+		} else if (!strcmp(argv[i], "-q") && i + 1 < argc) {
+			int32_t preset;
+
+			qualityName = argv[++i];
+			if (!strcmp(qualityName, "draft"))
+				preset = SWS_QUALITY_DRAFT;
+			else if (!strcmp(qualityName, "voice"))
+				preset = SWS_QUALITY_VOICE;
+			else if (!strcmp(qualityName, "broadcast"))
+				preset = SWS_QUALITY_BROADCAST;
+			else if (!strcmp(qualityName, "mastering"))
+				preset = SWS_QUALITY_MASTERING;
+			else {
+				printf("invalid quality: %s\n", qualityName);
+				return -1;
+			}
+			swsQualityPreset(&quality, preset);
+			presets |= 1 << preset;
+		} else {
+			printf("usage:\n");
+			printf("\tbench [options]\n");
+			printf("options:\n");
+			printf("\t-r <rates>\tcomma separated, every ordered pair of two different rates is run\n");
+			printf("\t\t\t(default 8000,16000,22050,44100,48000,96000,192000)\n");
+			printf("\t-c <channels>\tcomma separated (default 1,2,6,8,16)\n");
+			printf("\t-b <bits>\tcomma separated 8, 16, 24 (packed) or 32 (float) (default all)\n");
+			printf("\t-q <quality>\tdraft, voice, broadcast or mastering (default)\n");
+			printf("\t-t <threads>\tresample on this many threads, 0 for one per cpu (default 1)\n");
+			printf("\t-s <seconds>\tlength of the input signal (default 1)\n");
+			printf("\t-m <ms>\t\tminimum time spent on each case, the best run is kept (default 50)\n");
+			printf("\t-o <file>\twrite JSON results there, - for stdout (the table then goes to stderr)\n");
+			printf("\t-a\t\tmeasure accuracy against speed of every kernel path instead, -q may be repeated\n");
+			printf("\t\t\t(default rates 8000,44100,48000,96000 and every quality, -c, -b and -s don't apply)\n");
+			printf("\t-v\t\tverify threaded and streamed output of every kernel path against one thread instead,\n");
+			printf("\t\t\texits non zero on a difference, -q may be repeated (default a set of rate pairs\n");
+			printf("\t\t\tthat reaches every path, draft and mastering, -c, -b, -s and -t don't apply)\n");
+			return -1;
+		}
+	}
+	if (verify)
+		return verifyRun(ratesSet ? rates : NULL, numRates, presets ? presets : 0x9) ? 1 : 0;
+	if (accuracy) {
+		const int32_t accRates[] = { 8000, 44100, 48000, 96000 };
+
+		if (!ratesSet) {
+			memcpy(rates, accRates, sizeof(accRates));
+			numRates = 4;
+		}
+		return accuracyRun(rates, numRates, presets ? presets : 0xF, threads, minTime, jsonName);
+	}
+	for (int32_t b = 0; b < numBits; b++)
+	{
+		if (!(bits[b] == 8 || bits[b] == 16 || bits[b] == 24 || bits[b] == 32)) {
+			printf("invalid bits: %d\n", bits[b]);
+			return -1;
+		}
+		if (bits[b] == 24)
+			bits[b] = WAV_S24;
+	}
+	if (jsonName != NULL && !strcmp(jsonName, "-"))
+		table = stderr;
+
+	results = malloc(sizeof(benchResult) * numRates * numRates * numChans * numBits);
+	if (results == NULL)
+		wavFatal("main() allocation failure");
+	fprintf(table, "dsp %s, quality %s, %d thread(s), %g second signals\n", swsDspBest()->name, qualityName, threads, seconds);
+	fprintf(table, "%8s %8s %4s %4s %12s %12s %10s\n", "in", "out", "ch", "fmt", "ns/frame", "x realtime", "lut ms");
+	for (int32_t i = 0; i < numRates; i++)
+	{
+		for (int32_t o = 0; o < numRates; o++)
+		{
+			swsContext *ctx;
+			double lutMs;
+
+			if (rates[i] == rates[o] || rates[i] < 8000 || rates[o] < 8000)
+				continue;
+			ctx = buildContext(rates[i], rates[o], &quality, &lutMs);
+			for (int32_t c = 0; c < numChans; c++)
+			{
+				for (int32_t b = 0; b < numBits; b++)
+				{
+					benchResult *r = &results[count++];
+					wavSound in;
+					double t;
+
+					makeSignal(&in, rates[i], chans[c], bits[b], seconds);
+					t = timeResample(ctx, &in, threads, minTime, &r->outFrames);
+					free(in.data.bytes);
+					r->inFreq = rates[i];
+					r->outFreq = rates[o];
+					r->channels = chans[c];
+					r->bits = bits[b];
+					r->nsPerFrame = t * 1e9 / (double)r->outFrames;
+					r->realtime = seconds / t;
+					r->lutMs = lutMs;
+					fprintf(table, "%8d %8d %4d %4s %12.2f %12.1f %10.3f\n", r->inFreq, r->outFreq, r->channels,
+							formatName(r->bits), r->nsPerFrame, r->realtime, r->lutMs);
+					fflush(table);
+				}
+			}
+			swsContextFree(ctx);
+		}
+	}
+
+	if (jsonName != NULL) {
+		FILE *f = strcmp(jsonName, "-") ? fopen(jsonName, "w") : stdout;
+
+		if (f == NULL) {
+			printf("can't write '%s'\n", jsonName);
+			free(results);
+			return -1;
+		}
+		writeJson(f, results, count, qualityName, threads, seconds);
+		if (f != stdout)
+			fclose(f);
+	}
+	free(results);
+	return 0;
+}
@@ -0,0 +1,38 @@
+/*
+	bench.h
+
+	header resampler benchmark
+
+	muragami, muragami@wishray.com, Jason A. Petrasko 2024
+	MIT license: https://opensource.org/license/mit/
+*/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "sweeps.h"
+#include "swsdsp.h"
+
+#define BENCH_MAX_LIST		16
+
+// one rate pair, channel count and format
+typedef struct _benchResult {
+	int32_t inFreq;
+	int32_t outFreq;
+	int32_t channels;
+	int32_t bits;
+	int64_t outFrames;
+	double nsPerFrame;
+	double realtime;
+	// of the context this result used
+	double lutMs;
+} benchResult;
+
+// a monotonic clock in seconds
+double getTime(void);
+// the benchmark's deterministic test signal, bits as in wavSound (WAV_S24 for packed)
+void makeSignal(wavSound *snd, int32_t freq, int32_t channels, int32_t bits, double seconds);
+// best of repeated runs of swsResampleSndMT(), at least two and until minTime has passed
+double timeResample(const swsContext *ctx, wavSound *in, int32_t threads, double minTime, int64_t *outFrames);
+
+#endif
@@ -0,0 +1,235 @@
+/*
+	verify.c
+
+	threaded and streamed output against the whole buffer output. both are promised
+	to be bit identical to swsResampleSnd() on one thread, every kernel path is forced
+	in turn with swsContextCreateForced() and checked on every format.
+
+	muragami, muragami@wishray.com, Jason A. Petrasko 2024
+	MIT license: https://opensource.org/license/mit/
+*/
+
+#include "verify.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+// output frames each case makes, enough for a few thread chunks with a short last one
+#define VERIFY_OUT_FRAMES	40000
+// push and pull sizes are picked at random up to this many frames
+#define VERIFY_MAX_BLOCK	5000
+
+typedef struct _verifyVariant {
+	const char *name;
+	int32_t force;
+	int32_t minPhase;
+} verifyVariant;
+
+static const verifyVariant verifyVariants[] = {
+	{ "auto", 0, 0 },
+	{ "single", SWS_FORCE_SINGLE, 0 },
+	{ "direct", SWS_FORCE_DIRECT, 0 },
+	{ "lut32", SWS_FORCE_LUT | SWS_FORCE_LUT32, 0 },
+	{ "lut16", SWS_FORCE_LUT | SWS_FORCE_LUT16, 0 },
+	{ "fixed", SWS_FORCE_FIXED, 0 },
+	{ "float", SWS_FORCE_FLOAT, 0 },
+	{ "min phase", 0, 1 },
+};
+
+#define VERIFY_VARIANTS		(int32_t)(sizeof(verifyVariants) / sizeof(verifyVariant))
+
+// bank both ways, a cascade down and up, overlap-save down and up, a ratio only the
+// lut can do, a plain 1:2 and the format change alone
+static const int32_t verifyPairs[][2] = {
+	{ 44100, 48000 }, { 48000, 44100 }, { 44100, 8000 }, { 8000, 44100 }, { 48000, 96000 },
+	{ 96000, 48000 }, { 44100, 48001 }, { 22050, 44100 }, { 44100, 44100 },
+};
+
+#define VERIFY_PAIRS		(int32_t)(sizeof(verifyPairs) / sizeof(verifyPairs[0]))
+
+static const int32_t verifyBits[] = { 8, 16, 24, 32, WAV_S24, WAV_S32 };
+static const int32_t verifyChannels[] = { 1, 2, 3 };
+static const int32_t verifyThreads[] = { 2, 3, 5 };
+
+static const char *verifyQualityNames[] = { "draft", "voice", "broadcast", "mastering" };
+
+static const char* verifyFormatName(int32_t bits) {
+	switch (bits) {
+		case 8: return "u8";
+		case 16: return "s16";
+		case 24: return "f24";
+		case WAV_S24: return "s24";
+		case WAV_S32: return "s32";
+		default: return "f32";
+	}
+}
+
+static uint32_t verifyRandom(uint32_t *seed, uint32_t range) {
+	*seed = *seed * 1664525 + 1013904223;
+	return (*seed >> 8) % range;
+}
+
+// the first frame two outputs differ at, -1 when they match
+static int64_t verifyDiffers(const wavData *a, const uint8_t *b, size_t bBytes, int32_t frameBytes) {
+	size_t n = (a->numBytes < bBytes) ? a->numBytes : bBytes;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		if (a->bytes[i] != b[i])
+			return i / frameBytes;
+	}
+	if (a->numBytes != bBytes)
+		return n / frameBytes;
+	return -1;
+}
+
+// pushes the input in random blocks, pulling random amounts in between or not at
+// all, then flushes and drains. returns the output bytes written to out.
+static size_t verifyStream(const swsContext *ctx, const wavSound *in, int32_t outBits, uint8_t *out, size_t cap,
+						uint32_t seed) {
+	swsStream *s = swsStreamCreateTo(ctx, in->channels, in->bitsPerSample, outBits);
+	const int32_t inFrameBytes = in->channels * WAV_DATA_BYTES(in->bitsPerSample);
+	const int32_t outFrameBytes = in->channels * WAV_DATA_BYTES(outBits);
+	size_t pos = 0, got = 0, n;
+
+	while (pos < in->data.numBytes)
+	{
+		n = (1 + verifyRandom(&seed, VERIFY_MAX_BLOCK)) * inFrameBytes;
+		if (n > in->data.numBytes - pos)
+			n = in->data.numBytes - pos;
+		swsStreamPush(s, in->data.bytes + pos, n);
+		pos += n;
+		if (verifyRandom(&seed, 4) == 0)
+			continue;
+		do {
+			n = (1 + verifyRandom(&seed, VERIFY_MAX_BLOCK)) * outFrameBytes;
+			if (n > cap - got)
+				n = (cap - got) / outFrameBytes * outFrameBytes;
+			n = swsStreamPull(s, out + got, n);
+			got += n;
+		} while (n > 0);
+	}
+	swsStreamFlush(s);
+	do {
+		n = (1 + verifyRandom(&seed, VERIFY_MAX_BLOCK)) * outFrameBytes;
+		if (n > cap - got)
+			n = (cap - got) / outFrameBytes * outFrameBytes;
+		n = swsStreamPull(s, out + got, n);
+		got += n;
+	} while (n > 0);
+	swsStreamFree(s);
+	return got;
+}
+
+// every format, channel count and thread count of one context, returns the failures
+static int32_t verifyContext(const swsContext *ctx, int32_t inFreq, int32_t outFreq, const char *label,
+						int32_t *cases) {
+	const double seconds = (double)VERIFY_OUT_FRAMES / outFreq;
+	int32_t fails = 0;
+
+	for (int32_t c = 0; c < (int32_t)(sizeof(verifyChannels) / sizeof(int32_t)); c++)
+	{
+		for (int32_t b = 0; b < (int32_t)(sizeof(verifyBits) / sizeof(int32_t)); b++)
+		{
+			wavSound in;
+
+			makeSignal(&in, inFreq, verifyChannels[c], verifyBits[b], seconds);
+			// its own format and the next one along, so every format is also an output
+			// and each is converted from another on the way out
+			for (int32_t k = 0; k < 2; k++)
+			{
+				const int32_t numBits = (int32_t)(sizeof(verifyBits) / sizeof(int32_t));
+				const int32_t outBits = verifyBits[(b + k) % numBits];
+				const int32_t frameBytes = in.channels * WAV_DATA_BYTES(outBits);
+				wavSound ref, mt;
+				uint8_t *streamed;
+				size_t cap, got;
+				int64_t at;
+
+				swsResampleSndTo(ctx, &in, &ref, outBits, 1, NULL);
+				for (int32_t t = 0; t < (int32_t)(sizeof(verifyThreads) / sizeof(int32_t)); t++)
+				{
+					(*cases)++;
+					swsResampleSndTo(ctx, &in, &mt, outBits, verifyThreads[t], NULL);
+					at = verifyDiffers(&ref.data, mt.data.bytes, mt.data.numBytes, frameBytes);
+					if (at >= 0) {
+						printf("FAIL %s, %d ch %s to %s, %d threads differ from one at frame %lld\n", label,
+								in.channels, verifyFormatName(in.bitsPerSample), verifyFormatName(outBits),
+								verifyThreads[t], (long long)at);
+						fails++;
+					}
+					free(mt.data.bytes);
+				}
+
+				(*cases)++;
+				cap = ref.data.numBytes + VERIFY_MAX_BLOCK * frameBytes;
+				streamed = malloc(cap);
+				if (streamed == NULL)
+					wavFatal("verifyContext() allocation failure");
+				got = verifyStream(ctx, &in, outBits, streamed, cap, 0x9e3779b9u * (c * 16 + b * 2 + k + 1));
+				at = verifyDiffers(&ref.data, streamed, got, frameBytes);
+				if (at >= 0) {
+					printf("FAIL %s, %d ch %s to %s, stream differs from the whole buffer at frame %lld "
+							"(%lld of %lld frames)\n", label, in.channels, verifyFormatName(in.bitsPerSample),
+							verifyFormatName(outBits), (long long)at, (long long)(got / frameBytes),
+							(long long)(ref.data.numBytes / frameBytes));
+					fails++;
+				}
+				free(streamed);
+				free(ref.data.bytes);
+			}
+			free(in.data.bytes);
+		}
+	}
+	return fails;
+}
+
+static int32_t verifyPair(int32_t inFreq, int32_t outFreq, int32_t presets, int32_t *cases) {
+	int32_t fails = 0;
+
+	for (int32_t p = 0; p < 4; p++)
+	{
+		int32_t pairCases = 0, pairFails = 0;
+
+		if (!(presets & (1 << p)))
+			continue;
+		for (int32_t v = 0; v < VERIFY_VARIANTS; v++)
+		{
+			const verifyVariant *vv = &verifyVariants[v];
+			char label[128];
+			swsContext *ctx;
+			swsQuality q;
+
+			swsQualityPreset(&q, p);
+			q.minPhase = vv->minPhase;
+			ctx = swsContextCreateForced(inFreq, outFreq, &q, vv->force);
+			snprintf(label, sizeof(label), "%d -> %d %s %s", inFreq, outFreq, verifyQualityNames[p], vv->name);
+			pairFails += verifyContext(ctx, inFreq, outFreq, label, &pairCases);
+			swsContextFree(ctx);
+		}
+		printf("%6d -> %-6d %-10s %5d cases, %s\n", inFreq, outFreq, verifyQualityNames[p], pairCases,
+				pairFails ? "FAILED" : "ok");
+		fflush(stdout);
+		*cases += pairCases;
+		fails += pairFails;
+	}
+	return fails;
+}
+
+int verifyRun(const int32_t *rates, int32_t numRates, int32_t presets) {
+	int32_t cases = 0, fails = 0;
+
+	printf("dsp %s, threads and random stream blocks against one thread\n", swsDspBest()->name);
+	if (rates == NULL) {
+		for (int32_t i = 0; i < VERIFY_PAIRS; i++)
+			fails += verifyPair(verifyPairs[i][0], verifyPairs[i][1], presets, &cases);
+	} else {
+		for (int32_t i = 0; i < numRates; i++)
+		{
+			for (int32_t o = 0; o < numRates; o++)
+				fails += verifyPair(rates[i], rates[o], presets, &cases);
+		}
+	}
+	printf("%d cases, %d failed\n", cases, fails);
+	return fails;
+}
@@ -0,0 +1,22 @@
+/*
+	verify.h
+
+	header threaded and streamed output against the whole buffer output
+
+	muragami, muragami@wishray.com, Jason A. Petrasko 2024
+	MIT license: https://opensource.org/license/mit/
+*/
+
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include "bench.h"
+
+// checks that swsResampleSndTo() on several thread counts and swsStream with random
+// push and pull sizes give exactly the single thread output, for every input and
+// output format, 1, 2 and 3 channels and the kernel paths each rate pair reaches.
+// rates NULL runs a built in set of pairs that reaches every path, otherwise every
+// ordered pair of rates. prints each failure, returns the number of failed cases.
+int verifyRun(const int32_t *rates, int32_t numRates, int32_t presets);
+
+#endif
@@ -11,102 +11,755 @@
 #include "main.h"
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include <time.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <strings.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
 
 double getTime() {
 	struct timespec t;
-	clock_gettime(CLOCK_REALTIME, &t);
+	clock_gettime(CLOCK_MONOTONIC, &t);
 	return (double)t.tv_sec + (double)t.tv_nsec * 0.000000001;
 }
 
-int main(int argc, const char **argv) {
+// frames per block when streaming
+#define STREAM_FRAMES		16384
+
+// where designed filter tables are kept between runs, the usual per user cache
+static void defaultCacheDir(char *dir, size_t size) {
+	const char *base;
+
+	dir[0] = 0;
+#ifdef _WIN32
+	if ((base = getenv("LOCALAPPDATA")) != NULL && base[0])
+		snprintf(dir, size, "%s\\sweeps", base);
+#else
+	if ((base = getenv("XDG_CACHE_HOME")) != NULL && base[0])
+		snprintf(dir, size, "%s/sweeps", base);
+	else if ((base = getenv("HOME")) != NULL && base[0])
+		snprintf(dir, size, "%s/.cache/sweeps", base);
+#endif
+}
+
+// the format asked for, 24 and 32 bit are written packed straight from the kernel
+static int32_t outputBits(int32_t bits, int32_t tbits) {
+	if (tbits == 0)
+		return bits;
+	return (tbits >= 24) ? (tbits | WAV_PACKED) : tbits;
+}
+
+// what every conversion in a run shares
+typedef struct _convertOpts {
+	int32_t freq;
+	int32_t tbits;
+	int32_t threads;
+	int32_t stream;
+	int32_t stats;
+	const swsQuality *quality;
+} convertOpts;
+
+// what a file, or a whole batch, converted. sws has the time of each stage when
+// the run asked for stats, read and write are ours, the rest the library's.
+typedef struct _convertStats {
+	double seconds;
+	int64_t bytesIn;
+	int64_t bytesOut;
+	swsStats sws;
+} convertStats;
+
+// one stage, its share of them all and the rate it went through what it handled
+static void printStage(const char *name, double seconds, double total, double amount, const char *unit) {
+	printf("%-8s %10.4f %6.1f%%", name, seconds, total > 0.0 ? seconds * 100.0 / total : 0.0);
+	if (unit != NULL && seconds > 0.0)
+		printf(" %10.2f %s", amount / seconds, unit);
+	printf("\n");
+}
+
+// mapped input is only read as the kernel touches it, the read stage then has no rate
+static void printStats(const swsStats *s, int32_t mapped) {
+	const double total = s->readTime + s->decodeTime + s->lutTime + s->kernelTime + s->convertTime + s->writeTime;
+	const double mb = 1.0 / 1048576.0;
+
+	printf("%-8s %10s %7s %14s\n", "stage", "seconds", "share", "throughput");
+	printStage("read", s->readTime, total, s->bytesIn * mb, mapped ? NULL : "MB/s");
+	printStage("decode", s->decodeTime, total, s->bytesIn * mb, "MB/s");
+	printStage("lut", s->lutTime, total, 0.0, NULL);
+	printStage("kernel", s->kernelTime, total, s->framesOut / 1000000.0, "Mframe/s");
+	printStage("convert", s->convertTime, total, s->bytesOut * mb, "MB/s");
+	printStage("write", s->writeTime, total, s->bytesOut * mb, "MB/s");
+	printf("%lld frames in, %lld out, %.1f MB in, %.1f MB out.\n", (long long)s->framesIn, (long long)s->framesOut,
+			s->bytesIn * mb, s->bytesOut * mb);
+	printf("%lld allocations, %.1f MB.\n", (long long)s->allocations, s->allocBytes * mb);
+}
+
+// contexts by input rate, the output rate is the same for the whole run so every
+// file at one rate uses the same filter tables. the first job to need one builds it
+// while any others that want it wait.
+typedef struct _rateContexts {
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	const convertOpts *opts;
+	int32_t count;
+	int32_t *inFreq;
+	swsContext **ctx;
+} rateContexts;
+
+static void rateContextsInit(rateContexts *rc, const convertOpts *opts) {
+	memset(rc, 0, sizeof(rateContexts));
+	pthread_mutex_init(&rc->lock, NULL);
+	pthread_cond_init(&rc->ready, NULL);
+	rc->opts = opts;
+}
+
+static void rateContextsFree(rateContexts *rc) {
+	for (int32_t i = 0; i < rc->count; i++)
+		swsContextFree(rc->ctx[i]);
+	free(rc->inFreq);
+	free(rc->ctx);
+	pthread_mutex_destroy(&rc->lock);
+	pthread_cond_destroy(&rc->ready);
+}
+
+static swsContext* rateContext(rateContexts *rc, int32_t inFreq) {
+	swsContext *ctx;
+	int32_t i;
+
+	pthread_mutex_lock(&rc->lock);
+	for (i = 0; i < rc->count && rc->inFreq[i] != inFreq; i++);
+	if (i < rc->count) {
+		while (rc->ctx[i] == NULL)
+			pthread_cond_wait(&rc->ready, &rc->lock);
+		ctx = rc->ctx[i];
+		pthread_mutex_unlock(&rc->lock);
+		return ctx;
+	}
+	rc->inFreq = realloc(rc->inFreq, sizeof(int32_t) * (i + 1));
+	rc->ctx = realloc(rc->ctx, sizeof(swsContext*) * (i + 1));
+	if (rc->inFreq == NULL || rc->ctx == NULL)
+		wavFatal("rateContext() allocation failure");
+	rc->inFreq[i] = inFreq;
+	rc->ctx[i] = NULL;
+	rc->count++;
+	pthread_mutex_unlock(&rc->lock);
+
+	// built without the lock, jobs at other rates carry on
+	ctx = swsContextCreate(inFreq, rc->opts->freq, rc->opts->quality);
+	pthread_mutex_lock(&rc->lock);
+	rc->ctx[i] = ctx;
+	pthread_cond_broadcast(&rc->ready);
+	pthread_mutex_unlock(&rc->lock);
+	return ctx;
+}
+
+// what a host has to allow for, see swsContextLatency()
+static void printLatency(const swsContext *ctx, int32_t inFreq) {
+	double latency = swsContextLatency(ctx);
+
+	printf("\tlatency %.2f input frames, %.3f ms.\n", latency, latency * 1000.0 / inFreq);
+}
+
+// resample file to file a block at a time through a swsStream, only a couple of
+// blocks are ever in memory however long the input is
+static int streamFile(const char *inName, const char *outName, const convertOpts *o, rateContexts *rc,
+						convertStats *st, int32_t verbose) {
+	wavVirtualIO in;
+	wavVirtualIO out;
+	wavReader r;
+	wavWriter w;
+	swsStream *s;
+	uint8_t *inBlock;
+	uint8_t *outBlock;
+	size_t inFrameBytes;
+	size_t outFrameBytes;
+	size_t got;
+	int32_t outBits;
+	int64_t n;
+	double len;
+	double start;
+	double stop;
+	double t;
+	const char *e;
+
+	if (!strcmp(inName, outName)) {
+		printf("streaming needs an out_file other than the in_file\n");
+		return -1;
+	}
+	t = getTime();
+	wavioFileOpenRead(&in, inName);
+	e = wavReaderOpen(&r, &in, 1);
+	st->sws.readTime += getTime() - t;
+	if (e != NULL) {
+		printf("error loading '%s': %s\n", inName, e);
+		wavioFileClose(&in);
+		return -1;
+	}
+	outBits = outputBits(r.bitsPerSample, o->tbits);
+	t = getTime();
+	wavioFileOpenWrite(&out, outName);
+	e = wavWriterOpen(&w, &out, r.channels, o->freq, outBits);
+	st->sws.writeTime += getTime() - t;
+	if (e != NULL) {
+		printf("error writing '%s': %s\n", outName, e);
+		wavioFileClose(&in);
+		wavioFileClose(&out);
+		return -1;
+	}
+
+	len = (double)r.numFrames / (double)r.sampleRate;
+	if (verbose)
+		printf("streaming %.0f samples (%.2f seconds).\n", (double)r.numFrames, len);
+	start = getTime();
+	inFrameBytes = WAV_DATA_BYTES(r.bitsPerSample) * r.channels;
+	outFrameBytes = WAV_DATA_BYTES(outBits) * r.channels;
+	inBlock = malloc(STREAM_FRAMES * inFrameBytes);
+	outBlock = malloc(STREAM_FRAMES * outFrameBytes);
+	if (inBlock == NULL || outBlock == NULL)
+		wavFatal("streamFile() allocation failure");
+	s = swsStreamCreateTo(rateContext(rc, r.sampleRate), r.channels, r.bitsPerSample, outBits);
+	do {
+		t = getTime();
+		n = wavReaderRead(&r, inBlock, STREAM_FRAMES);
+		st->sws.readTime += getTime() - t;
+		if (n > 0)
+			swsStreamPush(s, inBlock, n * inFrameBytes);
+		else
+			swsStreamFlush(s);
+		while (e == NULL && (got = swsStreamPull(s, outBlock, STREAM_FRAMES * outFrameBytes)) > 0)
+		{
+			t = getTime();
+			e = wavWriterWrite(&w, outBlock, got / outFrameBytes);
+			st->sws.writeTime += getTime() - t;
+		}
+	} while (n > 0 && e == NULL);
+	t = getTime();
+	if (e == NULL)
+		e = wavWriterClose(&w);
+	wavioFileClose(&out);
+	st->sws.writeTime += getTime() - t;
+	swsStreamFree(s);
+	free(inBlock);
+	free(outBlock);
+	wavioFileClose(&in);
+	stop = getTime();
+	if (e != NULL) {
+		printf("error writing '%s': %s\n", outName, e);
+		return -1;
+	}
+	st->seconds = len;
+	st->bytesIn = r.numFrames * (int64_t)WAV_SAMPLE_BYTES(r.bitsPerSample) * r.channels;
+	st->bytesOut = w.dataBytes;
+	if (verbose) {
+		printf("complete.\n");
+		printf("conversion from %d[%d] to %d[%d] in %.2g seconds.\n", r.sampleRate, r.channels, o->freq, r.channels, stop - start);
+		printf("\t%.2fx realtime.\n", len / (stop - start));
+		if (o->quality->minPhase)
+			printLatency(rateContext(rc, r.sampleRate), r.sampleRate);
+	}
+	return 0;
+}
+
+// the input is mapped and resampled straight from the file, 24 and 32 bit packed
+// as they are, and converted to the target bits on the way out in the same pass.
+// pages of the map are read as the kernel first touches them, so the read stage is
+// only the mapping and the header, the rest of the reading counts as kernel.
+static int resampleFile(const char *inName, const char *outName, const convertOpts *o, rateContexts *rc,
+						convertStats *st, int32_t verbose) {
 	wavVirtualIO io;
+	wavVirtualIO inIo;
 	wavSound wIn;
 	wavSound wOut;
-	wavSound wOutC;
-	int32_t freq;
-	int32_t tbits;
 	double samples;
 	double start;
 	double stop;
 	double len;
+	double t;
 	const char *e;
 
-	if (argc == 4) {
-		wavioFileOpenRead(&io, argv[1]);
-		e = wavLoadFile(&io, &wIn, NULL);
-		wavioFileClose(&io);
-		if (e != NULL) {
-			printf("error loading '%s': %s", argv[1], e);
-			return -1;
-		}
-		freq = atoi(argv[3]);
-		if (freq < 8000) {
-			printf("invalid frequency: %s", argv[3]);
-			return -1;
-		}
-		if (wIn.bitsPerSample == 24) 
-			samples = (double)wIn.data.numBytes / (double)(wIn.channels * 4);
-		 else 
-			samples = (double)wIn.data.numBytes / (double)(wIn.channels * (wIn.bitsPerSample >> 3));
-		len = samples / (double)wIn.sampleRate;
+	t = getTime();
+	wavioMmapOpen(&inIo, inName);
+	e = wavLoadView(&inIo, &wIn);
+	st->sws.readTime += getTime() - t;
+	if (e != NULL) {
+		printf("error loading '%s': %s\n", inName, e);
+		wavioMmapClose(&inIo);
+		return -1;
+	}
+	samples = (double)wIn.data.numBytes / (double)(wIn.channels * WAV_DATA_BYTES(wIn.bitsPerSample));
+	len = samples / (double)wIn.sampleRate;
+	if (verbose)
 		printf("converting %.0f samples (%.2f seconds).\n", samples, len);
-		start = getTime();
-		swsResampleSnd(&wIn, &wOut, freq, NULL);
-		stop = getTime();
+	start = getTime();
+	swsResampleSndTo(rateContext(rc, wIn.sampleRate), &wIn, &wOut, outputBits(wIn.bitsPerSample, o->tbits), o->threads, NULL);
+	stop = getTime();
+	if (verbose) {
 		printf("complete.\n");
 		printf("conversion from %d[%d] to %d[%d] in %.2g seconds.\n", wIn.sampleRate, wIn.channels, wOut.sampleRate, wOut.channels, stop - start);
 		printf("\t%.2fx realtime.\n", len / (stop - start));
-		wavioFileOpenWrite(&io, argv[2]);
-		e = wavSaveFile(&io, &wOut);
-		wavioFileClose(&io);
-		if (e != NULL) {
-			printf("error writing '%s': %s", argv[2], e);
+		if (o->quality->minPhase)
+			printLatency(rateContext(rc, wIn.sampleRate), wIn.sampleRate);
+	}
+	st->seconds = len;
+	st->bytesIn = wIn.data.numBytes;
+	st->bytesOut = wOut.data.numBytes;
+	// done with the input, the output may be written over it
+	wavioMmapClose(&inIo);
+	t = getTime();
+	wavioFileOpenWrite(&io, outName);
+	e = wavSaveFile(&io, &wOut);
+	wavioFileClose(&io);
+	st->sws.writeTime += getTime() - t;
+	free(wOut.data.bytes);
+	if (e != NULL) {
+		printf("error writing '%s': %s\n", outName, e);
+		return -1;
+	}
+	return 0;
+}
+
+// with stats on the library adds its stages to st for everything this thread does
+// until the file is done, context creation for a new rate included
+static int convertFile(const char *inName, const char *outName, const convertOpts *o, rateContexts *rc,
+						convertStats *st, int32_t verbose) {
+	int ret;
+
+	memset(st, 0, sizeof(convertStats));
+	if (o->stats)
+		swsStatsAttach(&st->sws);
+	if (o->stream)
+		ret = streamFile(inName, outName, o, rc, st, verbose);
+	else
+		ret = resampleFile(inName, outName, o, rc, st, verbose);
+	swsStatsAttach(NULL);
+	return ret;
+}
+
+// ******************************************************************************
+// batch mode, many files on a pool of jobs. each job has its own queue of files and
+// takes from the front of it, largest first, and once that is empty steals from
+// the back of whichever queue has the most left.
+
+typedef struct _batchFile {
+	char *in;
+	char *out;
+	int64_t bytes;
+} batchFile;
+
+typedef struct _batchQueue {
+	pthread_mutex_t lock;
+	int64_t *files;
+	int64_t head;
+	int64_t tail;
+} batchQueue;
+
+typedef struct _batch {
+	batchFile *files;
+	int64_t numFiles;
+	batchQueue *queues;
+	int32_t jobs;
+	const convertOpts *opts;
+	rateContexts rates;
+	pthread_mutex_t lock;
+	int64_t done;
+	int64_t failed;
+	convertStats total;
+} batch;
+
+typedef struct _batchJob {
+	batch *b;
+	int32_t id;
+} batchJob;
+
+static int batchAdd(batch *b, const char *in, const char *out, const char *outDir) {
+	const char *name = in;
+	struct stat sb;
+	batchFile *f;
+
+	b->files = realloc(b->files, sizeof(batchFile) * (b->numFiles + 1));
+	if (b->files == NULL)
+		wavFatal("batchAdd() allocation failure");
+	f = &b->files[b->numFiles++];
+	f->bytes = (stat(in, &sb) == 0) ? sb.st_size : 0;
+	f->in = strdup(in);
+	if (out != NULL)
+		f->out = strdup(out);
+	else {
+		// same name in the output directory
+		for (const char *p = in; *p; p++)
+			if (*p == '/' || *p == '\\') name = p + 1;
+		f->out = malloc(strlen(outDir) + strlen(name) + 2);
+		if (f->out != NULL)
+			sprintf(f->out, "%s/%s", outDir, name);
+	}
+	if (f->in == NULL || f->out == NULL)
+		wavFatal("batchAdd() allocation failure");
+	return 0;
+}
+
+// every .wav in a directory, or a manifest of one input per line, optionally
+// followed by a tab and its output. blank lines and lines starting with # are skipped.
+static int batchList(batch *b, const char *source, const char *outDir) {
+	char line[4096];
+	struct stat sb;
+	FILE *f;
+
+	if (stat(source, &sb) != 0) {
+		printf("can't read batch source '%s'\n", source);
+		return -1;
+	}
+	if (S_ISDIR(sb.st_mode)) {
+		struct dirent *de;
+		DIR *d = opendir(source);
+
+		if (d == NULL) {
+			printf("can't read batch directory '%s'\n", source);
 			return -1;
 		}
-	} else if (argc == 5) {
-		wavioFileOpenRead(&io, argv[1]);
-		e = wavLoadFile(&io, &wIn, NULL);
-		wavioFileClose(&io);
-		if (e != NULL) {
-			printf("error loading '%s': %s", argv[1], e);
-			return -1;
+		while ((de = readdir(d)) != NULL)
+		{
+			size_t len = strlen(de->d_name);
+
+			if (len > 4 && !strcasecmp(de->d_name + len - 4, ".wav")) {
+				snprintf(line, sizeof(line), "%s/%s", source, de->d_name);
+				if (stat(line, &sb) == 0 && S_ISREG(sb.st_mode))
+					batchAdd(b, line, NULL, outDir);
+			}
 		}
-		freq = atoi(argv[3]);
-		if (freq < 8000) {
-			printf("invalid frequency: %s", argv[3]);
-			return -1;
+		closedir(d);
+		return 0;
+	}
+
+	f = fopen(source, "r");
+	if (f == NULL) {
+		printf("can't read batch manifest '%s'\n", source);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f) != NULL)
+	{
+		char *tab;
+
+		line[strcspn(line, "\r\n")] = 0;
+		if (line[0] == 0 || line[0] == '#')
+			continue;
+		tab = strchr(line, '\t');
+		if (tab != NULL)
+			*tab++ = 0;
+		batchAdd(b, line, (tab != NULL && tab[0]) ? tab : NULL, outDir);
+	}
+	fclose(f);
+	return 0;
+}
+
+static int64_t batchTake(batch *b, int32_t id) {
+	batchQueue *q = &b->queues[id];
+	int64_t file = -1;
+
+	pthread_mutex_lock(&q->lock);
+	if (q->head < q->tail)
+		file = q->files[q->head++];
+	pthread_mutex_unlock(&q->lock);
+
+	while (file < 0) {
+		int64_t most = 0;
+		int32_t victim = -1;
+
+		for (int32_t i = 0; i < b->jobs; i++)
+		{
+			int64_t left;
+
+			pthread_mutex_lock(&b->queues[i].lock);
+			left = b->queues[i].tail - b->queues[i].head;
+			pthread_mutex_unlock(&b->queues[i].lock);
+			if (left > most) {
+				most = left;
+				victim = i;
+			}
 		}
-		if (wIn.bitsPerSample == 24) 
-			samples = (double)wIn.data.numBytes / (double)(wIn.channels * 4);
-		 else 
-			samples = (double)wIn.data.numBytes / (double)(wIn.channels * (wIn.bitsPerSample >> 3));
-		len = samples / (double)wIn.sampleRate;
-		printf("converting %.0f samples (%.2f seconds).\n", samples, len);
-		start = getTime();
-		swsResampleSnd(&wIn, &wOut, freq, NULL);
-		stop = getTime();
-		printf("complete.\n");
-		printf("conversion from %d[%d] to %d[%d] in %.2g seconds.\n", wIn.sampleRate, wIn.channels, wOut.sampleRate, wOut.channels, stop - start);
-		printf("\t%.2fx realtime.\n", len / (stop - start));
-		// now convert the data to the proper bits
-		tbits = atoi(argv[4]);
-		if (!(tbits == 8 || tbits == 16 || tbits == 24 || tbits == 32)) {
-			printf("invalid target bits: %s", argv[4]);
+		if (victim < 0)
 			return -1;
+		// it may have emptied since, then look again
+		q = &b->queues[victim];
+		pthread_mutex_lock(&q->lock);
+		if (q->head < q->tail)
+			file = q->files[--q->tail];
+		pthread_mutex_unlock(&q->lock);
+	}
+	return file;
+}
+
+static void* batchWorker(void *arg) {
+	batchJob *job = (batchJob*)arg;
+	batch *b = job->b;
+	int64_t i;
+
+	while ((i = batchTake(b, job->id)) >= 0)
+	{
+		convertStats st;
+		double start = getTime();
+		int failed = convertFile(b->files[i].in, b->files[i].out, b->opts, &b->rates, &st, 0) != 0;
+		double stop = getTime();
+
+		pthread_mutex_lock(&b->lock);
+		b->done++;
+		if (failed)
+			b->failed++;
+		else {
+			b->total.seconds += st.seconds;
+			b->total.bytesIn += st.bytesIn;
+			b->total.bytesOut += st.bytesOut;
+			swsStatsAdd(&b->total.sws, &st.sws);
+			printf("[%lld/%lld] %s -> %s, %.2fx realtime\n", (long long)b->done, (long long)b->numFiles,
+					b->files[i].in, b->files[i].out, st.seconds / (stop - start));
 		}
-		swsConvertSnd(&wOut, &wOutC, tbits, NULL);
-		wavioFileOpenWrite(&io, argv[2]);
-		e = wavSaveFile(&io, &wOutC);
-		wavioFileClose(&io);
-		if (e != NULL) {
-			printf("error writing '%s': %s", argv[2], e);
+		pthread_mutex_unlock(&b->lock);
+	}
+	return NULL;
+}
+
+static int batchCompare(const void *x, const void *y) {
+	const batchFile *a = (const batchFile*)x, *c = (const batchFile*)y;
+
+	return (a->bytes < c->bytes) - (a->bytes > c->bytes);
+}
+
+static int batchRun(const char *source, const char *outDir, int32_t jobs, const convertOpts *o) {
+	batch b;
+	double start;
+	double stop;
+	int64_t i;
+
+	memset(&b, 0, sizeof(batch));
+	b.opts = o;
+	if (batchList(&b, source, outDir) != 0)
+		return -1;
+	if (b.numFiles == 0) {
+		printf("no files to convert in '%s'\n", source);
+		return -1;
+	}
+#ifdef _WIN32
+	_mkdir(outDir);
+#else
+	mkdir(outDir, 0755);
+#endif
+
+	if (jobs <= 0)
+		jobs = swsCpuCount();
+	if (jobs > b.numFiles)
+		jobs = b.numFiles;
+	b.jobs = jobs;
+
+	// largest first, dealt round robin so every queue starts with a big one
+	qsort(b.files, b.numFiles, sizeof(batchFile), batchCompare);
+	b.queues = calloc(jobs, sizeof(batchQueue));
+	if (b.queues == NULL)
+		wavFatal("batchRun() allocation failure");
+	for (int32_t j = 0; j < jobs; j++)
+	{
+		pthread_mutex_init(&b.queues[j].lock, NULL);
+		b.queues[j].files = malloc(sizeof(int64_t) * (b.numFiles / jobs + 1));
+		if (b.queues[j].files == NULL)
+			wavFatal("batchRun() allocation failure");
+	}
+	for (i = 0; i < b.numFiles; i++)
+	{
+		batchQueue *q = &b.queues[i % jobs];
+
+		q->files[q->tail++] = i;
+	}
+	rateContextsInit(&b.rates, o);
+	pthread_mutex_init(&b.lock, NULL);
+
+	printf("converting %lld files on %d jobs.\n", (long long)b.numFiles, jobs);
+	start = getTime();
+	{
+		pthread_t tid[jobs];
+		batchJob job[jobs];
+		int32_t j, started;
+
+		for (started = 0; started < jobs; started++)
+		{
+			job[started].b = &b;
+			job[started].id = started;
+			if (pthread_create(&tid[started], NULL, batchWorker, &job[started]) != 0)
+				break;
+		}
+		// whatever didn't start is stolen by the rest, with none this thread does it all
+		if (started == 0)
+			batchWorker(&job[0]);
+		for (j = 0; j < started; j++)
+			pthread_join(tid[j], NULL);
+	}
+	stop = getTime();
+
+	printf("complete, %lld converted, %lld failed, %d filter tables.\n", (long long)(b.done - b.failed),
+			(long long)b.failed, b.rates.count);
+	printf("%.2f seconds of audio in %.2f seconds.\n", b.total.seconds, stop - start);
+	printf("\t%.2fx realtime, %.1f MB/s in, %.1f MB/s out.\n", b.total.seconds / (stop - start),
+			b.total.bytesIn / (stop - start) / 1048576.0, b.total.bytesOut / (stop - start) / 1048576.0);
+	if (o->stats)
+		printStats(&b.total.sws, !o->stream);
+
+	rateContextsFree(&b.rates);
+	pthread_mutex_destroy(&b.lock);
+	for (int32_t j = 0; j < jobs; j++)
+	{
+		pthread_mutex_destroy(&b.queues[j].lock);
+		free(b.queues[j].files);
+	}
+	free(b.queues);
+	for (i = 0; i < b.numFiles; i++)
+	{
+		free(b.files[i].in);
+		free(b.files[i].out);
+	}
+	free(b.files);
+	return b.failed ? -1 : 0;
+}
+
+int main(int argc, const char **argv) {
+	rateContexts rates;
+	convertOpts opts;
+	convertStats st;
+	const char *args[4];
+	const char *batchSource = NULL;
+	int32_t nargs = 0;
+	int32_t threads = 1;
+	int32_t jobs = 0;
+	int32_t stream = 0;
+	int32_t stats = 0;
+	int32_t minPhase = 0;
+	swsQuality quality;
+	double attenuation = 0.0;
+	double width = 0.0;
+	char cacheDir[1024];
+	int32_t freq;
+	int32_t tbits = 0;
+	int ret;
+
+	swsQualityPreset(&quality, SWS_QUALITY_MASTERING);
+	defaultCacheDir(cacheDir, sizeof(cacheDir));
+
+	// options may appear anywhere, everything else is positional
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-s")) {
+			stream = 1;
+		} else if (!strcmp(argv[i], "--stats")) {
+			stats = 1;
+		} else if (!strcmp(argv[i], "-l")) {
+			minPhase = 1;
+		} else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+			batchSource = argv[++i];
+		} else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+			jobs = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-q") && i + 1 < argc) {
+			i++;
+			if (!strcmp(argv[i], "draft"))
+				swsQualityPreset(&quality, SWS_QUALITY_DRAFT);
+			else if (!strcmp(argv[i], "voice"))
+				swsQualityPreset(&quality, SWS_QUALITY_VOICE);
+			else if (!strcmp(argv[i], "broadcast"))
+				swsQualityPreset(&quality, SWS_QUALITY_BROADCAST);
+			else if (!strcmp(argv[i], "mastering"))
+				swsQualityPreset(&quality, SWS_QUALITY_MASTERING);
+			else {
+				printf("invalid quality: %s", argv[i]);
+				return -1;
+			}
+		} else if (!strcmp(argv[i], "-a") && i + 1 < argc) {
+			attenuation = atof(argv[++i]);
+			if (attenuation < 21.0) {
+				printf("invalid attenuation: %s", argv[i]);
+				return -1;
+			}
+		} else if (!strcmp(argv[i], "-w") && i + 1 < argc) {
+			width = atof(argv[++i]);
+			if (width <= 0.0 || width >= 1.0) {
+				printf("invalid transition width: %s", argv[i]);
+				return -1;
+			}
+		} else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+			i++;
+			if (!strcmp(argv[i], "none"))
+				cacheDir[0] = 0;
+			else
+				snprintf(cacheDir, sizeof(cacheDir), "%s", argv[i]);
+		} else if (nargs < 4) {
+			args[nargs++] = argv[i];
+		} else {
+			nargs = 0;
+			break;
+		}
+	}
+
+	// explicit values override the preset
+	if (attenuation > 0.0)
+		quality.attenuation = attenuation;
+	if (width > 0.0)
+		quality.upTransition = quality.downTransition = width;
+	quality.minPhase = minPhase;
+
+	swsSetCacheDir(cacheDir);
+
+	// a batch has the output directory where a single conversion has its files
+	if (batchSource != NULL) {
+		if (nargs == 2 || nargs == 3) {
+			memmove(&args[1], &args[0], sizeof(const char*) * nargs);
+			args[0] = batchSource;
+			nargs++;
+		} else
+			nargs = 0;
+	}
+
+	if (nargs == 3 || nargs == 4) {
+		freq = atoi(args[2]);
+		if (freq < 8000) {
+			printf("invalid frequency: %s", args[2]);
 			return -1;
 		}
+		if (nargs == 4) {
+			tbits = atoi(args[3]);
+			if (!(tbits == 8 || tbits == 16 || tbits == 24 || tbits == 32)) {
+				printf("invalid target bits: %s", args[3]);
+				return -1;
+			}
+		}
+		opts.freq = freq;
+		opts.tbits = tbits;
+		opts.threads = threads;
+		opts.stream = stream;
+		opts.stats = stats;
+		opts.quality = &quality;
+		if (batchSource != NULL)
+			return batchRun(args[0], args[1], jobs, &opts);
+		rateContextsInit(&rates, &opts);
+		ret = convertFile(args[0], args[1], &opts, &rates, &st, 1);
+		if (ret == 0 && stats)
+			printStats(&st.sws, !stream);
+		rateContextsFree(&rates);
+		return ret;
 	} else {
 		printf("usage:\n");
-		printf("\tsweeps <wave_file> <out_file> <new_freq>\n");
-		printf("\tsweeps <wave_file> <out_file> <new_freq> <new_bits>\n");
+		printf("\tsweeps [options] <wave_file> <out_file> <new_freq>\n");
+		printf("\tsweeps [options] <wave_file> <out_file> <new_freq> <new_bits>\n");
+		printf("\tsweeps [options] -b <manifest_or_dir> <out_dir> <new_freq> [new_bits]\n");
+		printf("options:\n");
+		printf("\t-t <threads>\tresample on this many threads, 0 for one per cpu (default 1)\n");
+		printf("\t-s\t\tstream file to file in a few blocks of memory, one thread, out_file must not be in_file\n");
+		printf("\t-b <source>\tconvert every .wav in a directory, or every line of a manifest (in_file[<tab>out_file])\n");
+		printf("\t-j <jobs>\tfiles converted at once in a batch, 0 for one per cpu (default 0)\n");
+		printf("\t-q <quality>\tdraft, voice, broadcast or mastering (default)\n");
+		printf("\t-a <dB>\t\tstopband attenuation, overrides the quality preset\n");
+		printf("\t-w <width>\ttransition width as a fraction of the input rate, overrides the preset\n");
+		printf("\t-c <dir>\tfilter table cache, none to turn it off (default ~/.cache/sweeps)\n");
+		printf("\t-l\t\tlow latency, minimum phase filters with the same magnitude response\n");
+		printf("\t--stats\t\ttime each stage (read, decode, lut, kernel, convert, write), count frames, bytes\n");
+		printf("\t\t\tand allocations, for the file or the whole batch\n");
 	}
 	return 0;
-}
\ No newline at end of file
+}
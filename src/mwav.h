@@ -5,13 +5,18 @@
 		* stdio
 		* PHYSFS (if WAV_USE_PHYSFS is defined before inclusion)
 		* virtual io (look at wavVirtualIO struct to see how)
+		* memory mapped files (wavioMmapOpen)
 		* memory blocks
+		* views, wavSound.data pointing into a mapped file or memory block
+		  instead of a copy (wavLoadView, wavLoadMemoryView)
 	
 	only accepts/handles:
 		8, 16, 24^, and 32^ bit PCM only
 
 		^internally 24 and 32 bit is turned into normalized IEEE float
 		- this means some small data loss on 32 bit PCM input FWIW
+		- unless loaded with wavLoadFilePacked / wavLoadMemoryPacked, which
+		  keep them as the packed integers in the file (WAV_S24, WAV_S32)
 
 	muragami, muragami@wishray.com, Jason A. Petrasko 2024
 	MIT license: https://opensource.org/license/mit/
@@ -26,10 +31,26 @@
 #include <physfs.h>
 #endif
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #define WRITE_FOURCC(dst, src) 	((dst)[0] = (src)[0], (dst)[1] = (src)[1],\
 								(dst)[2] = (src)[2], (dst)[3] = (src)[3])
 #define MATCH_FOURCC(dst, src) 	((dst)[0] == (src)[0] && (dst)[1] == (src)[1]\
 								 && (dst)[2] == (src)[2] && (dst)[3] == (src)[3])
+// bitsPerSample of 24 and 32 bit PCM kept packed as in the file, little endian
+// signed 3 and 4 byte integers, instead of expanded to float. WAV_BITS() is what
+// the file header holds.
+#define WAV_PACKED				0x100
+#define WAV_S24					(WAV_PACKED | 24)
+#define WAV_S32					(WAV_PACKED | 32)
+#define WAV_BITS(x)				((x) & 0xFF)
 //#define WAV_FAIL(x)				{ err = x; goto ferr; }
 #define WAV_FAILS(x)			{ err = x; goto serr; }
 
@@ -70,9 +91,9 @@ typedef struct _wavSound {
 	int32_t bitsPerSample;
 } wavSound;
 
-#define CBUFFER_CNT 	(1024)
-#define CBUFFER_BYTES 	(1024 * 3)
-#define CBUFFER_MBYTES 	(1024 * 4)
+#define CBUFFER_CNT 	(16384)
+#define CBUFFER_BYTES 	(16384 * 3)
+#define CBUFFER_MBYTES 	(16384 * 4)
 typedef struct _wavConvertBuffer {
 	uint8_t c[CBUFFER_MBYTES];
 } wavConvertBuffer;
@@ -188,86 +209,287 @@ static void __attribute__((unused)) wavioPhysFSClose(wavVirtualIO *io) {
 
 #endif
 
+// a whole file mapped read only, reads copy out of the mapping and views point
+// straight into it
+typedef struct _wavMmap {
+	uint8_t *base;
+	uint64_t size;
+	uint64_t pos;
+} wavMmap;
+
+static int64_t __attribute__((unused)) wavio_mread(void *f, void *buffer, uint64_t bytes) {
+	wavMmap *m = (wavMmap*)f;
+
+	if (m == NULL) return 0;
+	if (bytes > m->size - m->pos) bytes = m->size - m->pos;
+	memcpy(buffer, m->base + m->pos, bytes);
+	m->pos += bytes;
+	return bytes;
+}
+
+static int64_t __attribute__((unused)) wavio_mwrite(void *f, void *buffer, uint64_t bytes) {
+	return 0;
+}
+
+static int64_t __attribute__((unused)) wavio_mtell(void *f) {
+	if (f == NULL) return 0;
+	return ((wavMmap*)f)->pos;
+}
+
+static int64_t __attribute__((unused)) wavio_mseek(void *f, int64_t bytes) {
+	wavMmap *m = (wavMmap*)f;
+
+	if (m == NULL || bytes < 0) return -1;
+	m->pos = (uint64_t)bytes > m->size ? m->size : (uint64_t)bytes;
+	return 0;
+}
+
+// io->user is NULL if the file can't be opened or mapped (or is empty), the
+// loaders then fail like they do on a file that didn't open
+static void __attribute__((unused)) wavioMmapOpen(wavVirtualIO *io, const char *fname) {
+	wavMmap *m;
+	uint8_t *base = NULL;
+	uint64_t size = 0;
+
+	io->user = NULL;
+	io->read = wavio_mread;
+	io->write = wavio_mwrite;
+	io->tell = wavio_mtell;
+	io->seek = wavio_mseek;
+#ifdef _WIN32
+	HANDLE file, mapping;
+	LARGE_INTEGER fileSize;
+
+	file = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(file);
+		return;
+	}
+	size = fileSize.QuadPart;
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (mapping == NULL) return;
+	// the view keeps the mapping alive on its own
+	base = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (base == NULL) return;
+#else
+	struct stat sb;
+	int fd = open(fname, O_RDONLY);
+
+	if (fd < 0) return;
+	if (fstat(fd, &sb) != 0 || sb.st_size <= 0) {
+		close(fd);
+		return;
+	}
+	size = sb.st_size;
+	base = (uint8_t*)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) return;
+#endif
+	m = (wavMmap*)malloc(sizeof(wavMmap));
+	if (m == NULL) wavFatal("wavioMmapOpen() allocation failure");
+	m->base = base;
+	m->size = size;
+	m->pos = 0;
+	io->user = m;
+}
+
+// views loaded from the io point into the mapping, so they die with it
+static void __attribute__((unused)) wavioMmapClose(wavVirtualIO *io) {
+	wavMmap *m = (wavMmap*)io->user;
+
+	if (m == NULL) return;
+#ifdef _WIN32
+	UnmapViewOfFile(m->base);
+#else
+	munmap(m->base, m->size);
+#endif
+	free(m);
+	io->user = NULL;
+}
+
 // ******************************************************************************
-// File load and save
+// Incremental read and write
 
-static const char* __attribute__((unused)) wavSaveFile(wavVirtualIO *io, wavSound *snd) {
-	wavSaveHeader head;
-	uint32_t zero = 0;
+// reads the data chunk a block of frames at a time, in the same layout wavLoadFile
+// gives (24 and 32 bit as float unless packed), so a file never has to be
+// in memory at once
+typedef struct _wavReader {
+	wavVirtualIO *io;
+	int32_t channels;
+	int32_t sampleRate;
+	// layout of the frames read, as wavSound.bitsPerSample
+	int32_t bitsPerSample;
+	// bytes of a frame in the file
+	int32_t frameBytes;
+	int64_t numFrames;
+	int64_t framesLeft;
+} wavReader;
+
+// appends blocks of frames and fills the sizes in on close, seeking back to the
+// header, so the total doesn't have to be known up front
+typedef struct _wavWriter {
+	wavVirtualIO *io;
+	int32_t channels;
+	int32_t sampleRate;
+	// layout of the frames written, as wavSound.bitsPerSample
+	int32_t bitsPerSample;
+	int64_t start;
+	uint64_t dataBytes;
+} wavWriter;
+
+// bytes of one sample as it is in the file, and as it is in wavSound.data
+#define WAV_SAMPLE_BYTES(x)		(WAV_BITS(x) >> 3)
+#define WAV_DATA_BYTES(x)		((x) == 24 ? 4 : WAV_SAMPLE_BYTES(x))
+
+static void __attribute__((unused)) wav_header(wavSaveHeader *head, int32_t channels, int32_t sampleRate, int32_t bits,
+						uint32_t dataSize) {
+	WRITE_FOURCC(head->riffHeader.id, "RIFF");
+	head->riffHeader.size = dataSize + (dataSize & 1) + sizeof(*head) - sizeof(head->riffHeader);
+	WRITE_FOURCC(head->id_WAVE, "WAVE");
+
+	WRITE_FOURCC(head->fmt_Header.id, "fmt ");
+	head->fmt_Header.size = 16;
+	head->fmt_Data.formatTag = 1;
+	head->fmt_Data.channels = channels;
+	head->fmt_Data.sampleRate = sampleRate;
+	head->fmt_Data.avgBytesPerSec = sampleRate * channels * WAV_BITS(bits) / 8;
+	head->fmt_Data.blockAlign = WAV_SAMPLE_BYTES(bits) * channels;
+	head->fmt_Data.bitsPerSample = WAV_BITS(bits);
+
+	WRITE_FOURCC(head->dataHeader.id, "data");
+	head->dataHeader.size = dataSize;
+}
+
+// 24 and 32 bit PCM to and from float. 24 bit goes four samples at a time through
+// three whole words, shifted into place instead of assembled byte by byte.
+
+// in may be the back of out itself, starting n bytes in, then each group is read
+// before anything past what it read is written
+static void __attribute__((unused)) wav_unpack24(float *out, const uint8_t *in, uint64_t n) {
+	uint64_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		uint32_t w[3];
+
+		memcpy(w, in + i * 3, 12);
+		out[i] = (int32_t)(w[0] << 8) / 2147483648.0f;
+		out[i + 1] = (int32_t)((w[0] >> 16 & 0xFF00) | w[1] << 16) / 2147483648.0f;
+		out[i + 2] = (int32_t)((w[1] >> 8 & 0xFFFF00) | w[2] << 24) / 2147483648.0f;
+		out[i + 3] = (int32_t)(w[2] & 0xFFFFFF00) / 2147483648.0f;
+	}
+	for (; i < n; i++)
+		out[i] = (int32_t)((uint32_t)in[i * 3] << 8 | (uint32_t)in[i * 3 + 1] << 16 | (uint32_t)in[i * 3 + 2] << 24) / 2147483648.0f;
+}
+
+// in may be out itself
+static void __attribute__((unused)) wav_unpack32(float *out, const uint8_t *in, uint64_t n) {
+	uint64_t i;
+
+	for (i = 0; i < n; i++)
+	{
+		int32_t v;
+
+		memcpy(&v, in + i * 4, 4);
+		out[i] = (float)v / 2147483648.0f;
+	}
+}
+
+static void __attribute__((unused)) wav_pack24(uint8_t *out, const float *in, uint64_t n) {
+	uint64_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		uint32_t s0 = (int32_t)(in[i] * 2147483648.0f), s1 = (int32_t)(in[i + 1] * 2147483648.0f);
+		uint32_t s2 = (int32_t)(in[i + 2] * 2147483648.0f), s3 = (int32_t)(in[i + 3] * 2147483648.0f);
+		uint32_t w[3];
+
+		w[0] = s0 >> 8 | (s1 & 0xFF00) << 16;
+		w[1] = s1 >> 16 | (s2 & 0xFFFF00) << 8;
+		w[2] = s2 >> 24 | (s3 & 0xFFFFFF00);
+		memcpy(out + i * 3, w, 12);
+	}
+	for (; i < n; i++)
+	{
+		int32_t v = (in[i] * 2147483648.0f);
+
+		out[i * 3] = (v & 0xFF00) >> 8;
+		out[i * 3 + 1] = (v & 0xFF0000) >> 16;
+		out[i * 3 + 2] = (v & 0xFF000000) >> 24;
+	}
+}
+
+static void __attribute__((unused)) wav_pack32(uint8_t *out, const float *in, uint64_t n) {
+	uint64_t i;
+
+	for (i = 0; i < n; i++)
+	{
+		int32_t v = (in[i] * 2147483648.0f);
+
+		memcpy(out + i * 4, &v, 4);
+	}
+}
+
+// read samples into the given layout, returns samples read. 24 and 32 bit are read
+// in one go into the back of the float buffer and unpacked in place.
+static uint64_t __attribute__((unused)) wav_read_data(wavVirtualIO *io, void *out, uint64_t samples, int32_t bits) {
+	uint64_t bytes = samples * WAV_SAMPLE_BYTES(bits), back = samples * 4 - bytes;
+	int64_t got;
+
+	if (bits != 24 && bits != 32)
+		return io->read(io->user, out, bytes) / WAV_SAMPLE_BYTES(bits);
+
+	got = io->read(io->user, (uint8_t*)out + back, bytes);
+	if (got <= 0) return 0;
+	samples = got / (bits >> 3);
+	if (bits == 24)
+		wav_unpack24((float*)out, (uint8_t*)out + back, samples);
+	else
+		wav_unpack32((float*)out, (uint8_t*)out, samples);
+	return samples;
+}
+
+static const char* __attribute__((unused)) wav_write_data(wavVirtualIO *io, const void *data, uint64_t samples, int32_t bits) {
+	wavConvertBuffer b;
+	uint64_t bytes = samples * WAV_SAMPLE_BYTES(bits);
 	const char *err = NULL;
 
-	WRITE_FOURCC(head.riffHeader.id, "RIFF");
-	head.riffHeader.size = snd->data.numBytes + sizeof(head) - sizeof(head.riffHeader);
-	WRITE_FOURCC(head.id_WAVE, "WAVE");
-
-	WRITE_FOURCC(head.fmt_Header.id, "fmt ");
-	head.fmt_Header.size = 16;
-	head.fmt_Data.formatTag = 1;
-	head.fmt_Data.channels = snd->channels;
-	head.fmt_Data.sampleRate = snd->sampleRate;
-	head.fmt_Data.avgBytesPerSec = snd->sampleRate * snd->channels * snd->bitsPerSample / 8;
-	head.fmt_Data.blockAlign = (snd->bitsPerSample >> 3) * snd->channels;
-	head.fmt_Data.bitsPerSample = snd->bitsPerSample;
-
-	WRITE_FOURCC(head.dataHeader.id, "data");
-	if (snd->bitsPerSample == 24) 
-		head.dataHeader.size = (uint64_t)snd->data.numBytes * 3ll / 4ll;
-	 else 
-	 	head.dataHeader.size = snd->data.numBytes;
+	if (bits != 24 && bits != 32) {
+		if (io->write(io->user, (void*)data, bytes) != bytes) WAV_FAILS("Failed to write data")
+		return NULL;
+	}
 
-	if (io->write(io->user, &head, sizeof(head)) != sizeof(head)) WAV_FAILS("Failed to write header")
-	if (snd->bitsPerSample == 24) {
-		wavConvertBuffer b;
-		uint32_t samples = snd->data.numBytes >> 2;
-		float *f = (float*)snd->data.bytes;
-		while (samples > 0) {
-			int32_t cnt;
-			if (samples > CBUFFER_CNT) cnt = CBUFFER_CNT;
-			 else cnt = samples;
-			for (int i = 0; i < cnt; i++) {
-				int32_t v = (*f * 2147483648.0f);
-				b.c[i * 3] = (v & 0xFF00) >> 8;
-				b.c[i * 3 + 1] = (v & 0xFF0000) >> 16;
-				b.c[i * 3 + 2] = (v & 0xFF000000) >> 24;
-				f++;
-			}
-			samples -= cnt;
-			if (io->write(io->user, b.c, cnt * 3) != cnt * 3) WAV_FAILS("Failed to write data")
-		}
-		// uneven bytes written? add one null
-		if ((snd->data.numBytes / (4 * snd->channels) * (snd->bitsPerSample >> 3) * snd->channels) % 2 > 0)
-			io->write(io->user, &zero, 1);
-	} else if (snd->bitsPerSample == 32) {
-		wavConvertBuffer b;
-		uint32_t samples = snd->data.numBytes >> 2;
-		float *f = (float*)snd->data.bytes;
-		while (samples > 0) {
-			int32_t cnt;
-			if (samples > CBUFFER_CNT) cnt = CBUFFER_CNT;
-			 else cnt = samples;
-			for (int i = 0; i < cnt; i++) {
-				int32_t v = (*f * 2147483648.0f);
-				memcpy(b.c + i * 4, &v, 4);
-				f++;
-			}
-			samples -= cnt;
-			if (io->write(io->user, b.c, cnt * 4) != cnt * 4) WAV_FAILS("Failed to write data")
-		}
-	} else {
-		if (io->write(io->user, snd->data.bytes, snd->data.numBytes) != snd->data.numBytes) WAV_FAILS("Failed to write data")
+	const float *f = (const float*)data;
+	while (samples > 0) {
+		int32_t cnt;
+		if (samples > CBUFFER_CNT) cnt = CBUFFER_CNT;
+		 else cnt = samples;
+		if (bits == 24)
+			wav_pack24(b.c, f, cnt);
+		else
+			wav_pack32(b.c, f, cnt);
+		f += cnt;
+		samples -= cnt;
+		if (io->write(io->user, b.c, cnt * (bits >> 3)) != cnt * (bits >> 3)) WAV_FAILS("Failed to write data")
 	}
 
 serr:
 	return err;
 }
 
-static const char* __attribute__((unused)) wavLoadFile(wavVirtualIO *io, wavSound *snd, xmalloc xm) {
+// finds the format and the data chunk, leaving io at the first frame. packed keeps
+// 24 and 32 bit as WAV_S24 / WAV_S32 instead of float.
+static const char* __attribute__((unused)) wavReaderOpen(wavReader *r, wavVirtualIO *io, int32_t packed) {
 	wavChunkHeader chunkHeader;
 	char waveId[4];
+	int32_t haveFmt = 0;
 	const char *err = NULL;
 
-	if (xm == NULL) xm = malloc;
-
+	memset(r, 0, sizeof(wavReader));
+	r->io = io;
 	if (io->read(io->user, &chunkHeader, sizeof(chunkHeader)) != sizeof(chunkHeader)) WAV_FAILS("Failed to read RIFF header")
 	if (!MATCH_FOURCC(chunkHeader.id, "RIFF")) WAV_FAILS("File is not RIFF")
 	if (io->read(io->user, waveId, 4) != 4) WAV_FAILS("Failed to read WAVE header")
@@ -278,7 +500,8 @@ static const char* __attribute__((unused)) wavLoadFile(wavVirtualIO *io, wavSoun
 		size_t endPos;
 		if (io->read(io->user, &chunkHeader, sizeof(chunkHeader)) != sizeof(chunkHeader)) break;
 
-		endPos = io->tell(io->user) + chunkHeader.size;
+		// chunks are padded to even sizes
+		endPos = io->tell(io->user) + chunkHeader.size + (chunkHeader.size & 1);
 
 		if (MATCH_FOURCC(chunkHeader.id, "fmt ")) {
 			wavFmtData fmtData;
@@ -288,227 +511,272 @@ static const char* __attribute__((unused)) wavLoadFile(wavVirtualIO *io, wavSoun
 			if (fmtData.formatTag != 1) WAV_FAILS("File is not PCM")
 			if (!(fmtData.bitsPerSample == 16 || fmtData.bitsPerSample == 8 || fmtData.bitsPerSample == 24
 				|| fmtData.bitsPerSample == 32)) WAV_FAILS("File is unsupported bits per sample.")
-			snd->channels = fmtData.channels;
-			snd->sampleRate = fmtData.sampleRate;
-			snd->bitsPerSample = fmtData.bitsPerSample;
-		} else if (MATCH_FOURCC(chunkHeader.id, "data"))
-		{
-			if (snd->bitsPerSample == 24) {
-				snd->data.numBytes = (uint64_t)chunkHeader.size * 4ll / 3ll;
-				snd->data.bytes = (uint8_t *)xm(snd->data.numBytes);
-				if (snd->data.bytes == NULL) WAV_FAILS("Failed on data allocation.")
-				float *f = (float*)snd->data.bytes;
-				wavConvertBuffer b;
-				while (chunkHeader.size > 0) {
-					int cnt;
-					if (chunkHeader.size > CBUFFER_BYTES) cnt = CBUFFER_BYTES;
-					 else cnt = chunkHeader.size;
-					if (io->read(io->user, b.c, cnt) != cnt) WAV_FAILS("Failed to read data.")
-					for (int i = 0; i < cnt / 3; i++) {
-						*f = ((b.c[i * 3] << 8) + (b.c[i * 3 + 1] << 16) + (b.c[i * 3 + 2] << 24)) / 2147483648.0f;
-						f++;
-					}
-					chunkHeader.size -= cnt;
-				}
-			} else if (snd->bitsPerSample == 32) {
-				snd->data.numBytes = chunkHeader.size;
-				snd->data.bytes = (uint8_t *)xm(snd->data.numBytes);
-				if (snd->data.bytes == NULL) WAV_FAILS("Failed on data allocation.")
-				float *f = (float*)snd->data.bytes;
-				wavConvertBuffer32 b;
-				while (chunkHeader.size > 0) {
-					int cnt;
-					if (chunkHeader.size > CBUFFER_MBYTES) cnt = CBUFFER_MBYTES;
-					 else cnt = chunkHeader.size;
-					if (io->read(io->user, b.c, cnt) != cnt) WAV_FAILS("Failed to read data.")
-					for (int i = 0; i < cnt / 4; i++) {
-						*f = (float)b.c[i] / 2147483648.0f;
-						f++;
-					}
-					chunkHeader.size -= cnt;
-				}				
-			} else {
-				snd->data.bytes = (unsigned char *)xm(chunkHeader.size);
-				if (snd->data.bytes == NULL) WAV_FAILS("Failed on data allocation.")
-				chunkHeader.size = io->read(io->user, snd->data.bytes, chunkHeader.size);
-				snd->data.numBytes = chunkHeader.size;	
-			}
-			
+			if (fmtData.channels == 0) WAV_FAILS("Badly formatted 'fmt ' chunk")
+			r->channels = fmtData.channels;
+			r->sampleRate = fmtData.sampleRate;
+			r->bitsPerSample = fmtData.bitsPerSample;
+			if (packed && r->bitsPerSample >= 24) r->bitsPerSample |= WAV_PACKED;
+			r->frameBytes = (fmtData.bitsPerSample >> 3) * r->channels;
+			haveFmt = 1;
+		} else if (MATCH_FOURCC(chunkHeader.id, "data")) {
+			if (!haveFmt) WAV_FAILS("Missing 'fmt ' chunk")
+			r->numFrames = r->framesLeft = chunkHeader.size / r->frameBytes;
+			return NULL;
 		}
 
 		io->seek(io->user, endPos);
 	}
+	WAV_FAILS("Missing 'data' chunk")
 
 serr:
 	return err;
 }
 
+// up to frames frames into out, returns the frames read, 0 at the end. a file
+// shorter than its header says just ends early.
+static int64_t __attribute__((unused)) wavReaderRead(wavReader *r, void *out, int64_t frames) {
+	int64_t got;
+
+	if (frames > r->framesLeft) frames = r->framesLeft;
+	if (frames <= 0) return 0;
+	got = wav_read_data(r->io, out, frames * r->channels, r->bitsPerSample) / r->channels;
+	r->framesLeft = (got < frames) ? 0 : r->framesLeft - got;
+	return got;
+}
+
+// bitsPerSample is the layout the blocks come in, as wavSound.bitsPerSample
+static const char* __attribute__((unused)) wavWriterOpen(wavWriter *w, wavVirtualIO *io, int32_t channels, int32_t sampleRate,
+						int32_t bitsPerSample) {
+	wavSaveHeader head;
+
+	w->io = io;
+	w->channels = channels;
+	w->sampleRate = sampleRate;
+	w->bitsPerSample = bitsPerSample;
+	w->start = io->tell(io->user);
+	w->dataBytes = 0;
+	// sizes of 0 until close, a reader sees an empty file if it is never closed
+	wav_header(&head, channels, sampleRate, bitsPerSample, 0);
+	if (io->write(io->user, &head, sizeof(head)) != sizeof(head)) return "Failed to write header";
+	return NULL;
+}
+
+static const char* __attribute__((unused)) wavWriterWrite(wavWriter *w, const void *data, int64_t frames) {
+	uint64_t samples = (uint64_t)frames * w->channels;
+	uint64_t bytes = samples * WAV_SAMPLE_BYTES(w->bitsPerSample);
+
+	if (w->dataBytes + bytes > 0xFFFFFFFEull - sizeof(wavSaveHeader)) return "Data too large for a wav file";
+	w->dataBytes += bytes;
+	return wav_write_data(w->io, data, samples, w->bitsPerSample);
+}
+
+// pads the data chunk and patches the header sizes, io must be able to seek
+static const char* __attribute__((unused)) wavWriterClose(wavWriter *w) {
+	wavVirtualIO *io = w->io;
+	wavSaveHeader head;
+	uint32_t zero = 0;
+	int64_t end = w->start + sizeof(head) + w->dataBytes + (w->dataBytes & 1);
+	const char *err = NULL;
+
+	if ((w->dataBytes & 1) && io->write(io->user, &zero, 1) != 1) WAV_FAILS("Failed to write data")
+	wav_header(&head, w->channels, w->sampleRate, w->bitsPerSample, w->dataBytes);
+	if (io->seek(io->user, w->start) != 0) WAV_FAILS("Failed to seek to header")
+	if (io->write(io->user, &head, sizeof(head)) != sizeof(head)) WAV_FAILS("Failed to write header")
+	if (io->seek(io->user, end) != 0) WAV_FAILS("Failed to seek to end")
+
+serr:
+	return err;
+}
+
+// ******************************************************************************
+// File load and save
+
+static const char* __attribute__((unused)) wavSaveFile(wavVirtualIO *io, wavSound *snd) {
+	wavSaveHeader head;
+	uint64_t samples = snd->data.numBytes / WAV_DATA_BYTES(snd->bitsPerSample);
+	uint64_t dataSize = samples * WAV_SAMPLE_BYTES(snd->bitsPerSample);
+	uint32_t zero = 0;
+	const char *err = NULL;
+
+	wav_header(&head, snd->channels, snd->sampleRate, snd->bitsPerSample, dataSize);
+	if (io->write(io->user, &head, sizeof(head)) != sizeof(head)) WAV_FAILS("Failed to write header")
+	if ((err = wav_write_data(io, snd->data.bytes, samples, snd->bitsPerSample)) != NULL) goto serr;
+	// uneven bytes written? add one null
+	if (dataSize & 1)
+		io->write(io->user, &zero, 1);
+
+serr:
+	return err;
+}
+
+static const char* __attribute__((unused)) wav_load_file(wavVirtualIO *io, wavSound *snd, xmalloc xm, int32_t packed) {
+	wavReader r;
+	const char *err;
+	int64_t frameBytes;
+
+	if (xm == NULL) xm = malloc;
+
+	if ((err = wavReaderOpen(&r, io, packed)) != NULL) return err;
+	snd->channels = r.channels;
+	snd->sampleRate = r.sampleRate;
+	snd->bitsPerSample = r.bitsPerSample;
+	frameBytes = WAV_DATA_BYTES(r.bitsPerSample) * r.channels;
+	snd->data.bytes = (uint8_t *)xm(r.numFrames * frameBytes);
+	if (snd->data.bytes == NULL) return "Failed on data allocation.";
+	snd->data.numBytes = wavReaderRead(&r, snd->data.bytes, r.numFrames) * frameBytes;
+	return NULL;
+}
+
+static const char* __attribute__((unused)) wavLoadFile(wavVirtualIO *io, wavSound *snd, xmalloc xm) {
+	return wav_load_file(io, snd, xm, 0);
+}
+
+// 24 and 32 bit stay packed (WAV_S24, WAV_S32), no float copy is made
+static const char* __attribute__((unused)) wavLoadFilePacked(wavVirtualIO *io, wavSound *snd, xmalloc xm) {
+	return wav_load_file(io, snd, xm, 1);
+}
+
 // ******************************************************************************
 // Memory load and save
 
 static const char* __attribute__((unused)) wavSaveMemory(const char *filename, wavSound *snd, wavData *out, xmalloc xm) {
 	wavSaveHeader head;
-	uint32_t dataSize;
-	int32_t odd = (snd->data.numBytes / (4 * snd->channels) * (snd->bitsPerSample >> 3) * snd->channels) % 2 > 0;
-
-	if (snd->bitsPerSample == 24) 
-		dataSize = odd + (uint64_t)snd->data.numBytes * 3ll / 4ll;
-	 else 
-	 	dataSize = snd->data.numBytes;
+	uint64_t samples = snd->data.numBytes / WAV_DATA_BYTES(snd->bitsPerSample);
+	uint64_t dataSize = samples * WAV_SAMPLE_BYTES(snd->bitsPerSample);
 
 	if (xm == NULL) xm = malloc;
-	out->bytes = (uint8_t*)xm(sizeof(head) + dataSize);
+	// uneven bytes written? add one null
+	out->numBytes = sizeof(head) + dataSize + (dataSize & 1);
+	out->bytes = (uint8_t*)xm(out->numBytes);
 	if (out->bytes == NULL) return "Failed on data allocation.";
-	out->numBytes = sizeof(head) + snd->data.numBytes;
-
-	WRITE_FOURCC(head.riffHeader.id, "RIFF");
-	head.riffHeader.size = snd->data.numBytes + sizeof(head) - sizeof(head.riffHeader);
-	WRITE_FOURCC(head.id_WAVE, "WAVE");
-
-	WRITE_FOURCC(head.fmt_Header.id, "fmt ");
-	head.fmt_Header.size = 16;
-	head.fmt_Data.formatTag = 1;
-	head.fmt_Data.channels = snd->channels;
-	head.fmt_Data.sampleRate = snd->sampleRate;
-	head.fmt_Data.avgBytesPerSec = snd->sampleRate * snd->channels * snd->bitsPerSample / 8;
-	head.fmt_Data.blockAlign = (snd->bitsPerSample >> 3) * snd->channels;
-	head.fmt_Data.bitsPerSample = snd->bitsPerSample;
-
-	WRITE_FOURCC(head.dataHeader.id, "data");
-	head.dataHeader.size = dataSize;
-	
+
+	wav_header(&head, snd->channels, snd->sampleRate, snd->bitsPerSample, dataSize);
 	memcpy(out->bytes, &head, sizeof(head));
 	uint8_t *p = out->bytes + sizeof(head);
-	if (snd->bitsPerSample == 24) {
-		wavConvertBuffer b;
-		uint32_t samples = snd->data.numBytes >> 2;
-		float *f = (float*)snd->data.bytes;
-		while (samples > 0) {
-			int32_t cnt;
-			if (samples > CBUFFER_CNT) cnt = CBUFFER_CNT;
-			 else cnt = samples;
-			for (int i = 0; i < cnt; i++) {
-				int32_t v = (*f * 2147483648.0f);
-				b.c[i * 3] = (v & 0xFF00) >> 8;
-				b.c[i * 3 + 1] = (v & 0xFF0000) >> 16;
-				b.c[i * 3 + 2] = (v & 0xFF000000) >> 24;
-				f++;
-			}
-			samples -= cnt;
-			memcpy(p, b.c, cnt * 3);
-			p += cnt *3;
-		}
-		// uneven bytes written? add one null
-		if (odd) *p = 0;
-	} else if (snd->bitsPerSample == 32) {
-		wavConvertBuffer b;
-		uint32_t samples = snd->data.numBytes >> 2;
-		float *f = (float*)snd->data.bytes;
-		while (samples > 0) {
-			int32_t cnt;
-			if (samples > CBUFFER_CNT) cnt = CBUFFER_CNT;
-			 else cnt = samples;
-			for (int i = 0; i < cnt; i++) {
-				int32_t v = (*f * 2147483648.0f);
-				memcpy(b.c + i * 4, &v, 4);
-				f++;
-			}
-			samples -= cnt;
-			memcpy(p, b.c, cnt * 3);
-			p += cnt *3;
-		}
-	} else {
-		memcpy(p, snd->data.bytes, snd->data.numBytes);
-	}
+	if (snd->bitsPerSample == 24)
+		wav_pack24(p, (const float*)snd->data.bytes, samples);
+	else if (snd->bitsPerSample == 32)
+		wav_pack32(p, (const float*)snd->data.bytes, samples);
+	else
+		memcpy(p, snd->data.bytes, dataSize);
+	if (dataSize & 1) p[dataSize] = 0;
 	
 	return NULL;
 }
 
-static const char* __attribute__((unused)) wavLoadMemory(wavData *in, wavSound *snd, xmalloc xm) {
-	wavChunkHeader* pHeader;
-	int32_t mpos = 0;
+// walk the chunks of a wav in memory, fill in the format and find the data. the
+// buffer is only read, so it may be a read only mapping.
+static const char* __attribute__((unused)) wav_parse_memory(const wavData *in, wavSound *snd, const uint8_t **data,
+						size_t *dataSize, int32_t packed) {
+	wavChunkHeader chunk;
+	wavFmtData fmt;
+	size_t mpos = 0;
+	int32_t haveFmt = 0;
 	const char *err = NULL;
 
-	if (xm == NULL) xm = malloc;
-
-	pHeader = (wavChunkHeader*)in->bytes;
+	*data = NULL;
+	*dataSize = 0;
 	if (mpos + sizeof(wavChunkHeader) > in->numBytes) WAV_FAILS("Failed to read RIFF header")
+	memcpy(&chunk, in->bytes, sizeof(chunk));
 	mpos += sizeof(wavChunkHeader);
-	if (!MATCH_FOURCC(pHeader->id, "RIFF")) WAV_FAILS("File is not RIFF")
+	if (!MATCH_FOURCC(chunk.id, "RIFF")) WAV_FAILS("File is not RIFF")
 	if (mpos + 4 > in->numBytes) WAV_FAILS("Failed to read WAVE header")
 	if (!MATCH_FOURCC(in->bytes + mpos, "WAVE")) WAV_FAILS("File is not RIFF WAVE")
 	mpos += 4;
 
-	while (mpos < in->numBytes)
+	while (mpos + sizeof(wavChunkHeader) <= in->numBytes)
 	{
-		if (mpos + sizeof(wavChunkHeader) > in->numBytes) break;
-		pHeader = (wavChunkHeader*)(in->bytes + mpos);
+		memcpy(&chunk, in->bytes + mpos, sizeof(chunk));
 		mpos += sizeof(wavChunkHeader);
 
-		if (MATCH_FOURCC(pHeader->id, "fmt ")) {
-			wavFmtData* pFmt;
-
-			if (pHeader->size < sizeof(wavFmtData)) WAV_FAILS("Badly formatted 'fmt ' chunk")
-			if (mpos + sizeof(wavChunkHeader) > in->numBytes) WAV_FAILS("Failed to read 'fmt_' chunk")
-			pFmt = (wavFmtData*)in->bytes + mpos;
-			mpos += pHeader->size;
-			if (pFmt->formatTag != 1) WAV_FAILS("File is not PCM")
-			if (!(pFmt->bitsPerSample == 16 || pFmt->bitsPerSample == 8 || pFmt->bitsPerSample == 24
-				|| pFmt->bitsPerSample == 32)) WAV_FAILS("File is unsupported bits per sample.")
-			snd->channels = pFmt->channels;
-			snd->sampleRate = pFmt->sampleRate;
-			snd->bitsPerSample = pFmt->bitsPerSample;
-		} else if (MATCH_FOURCC(pHeader->id, "data"))
-		{
-			if (snd->bitsPerSample == 24) {
-				snd->data.numBytes = (uint64_t)pHeader->size * 4ll / 3ll;
-				snd->data.bytes = (uint8_t *)xm(snd->data.numBytes);
-				if (snd->data.bytes == NULL) WAV_FAILS("Failed on data allocation.")
-				float *f = (float*)snd->data.bytes;
-				wavConvertBuffer b;
-				while (pHeader->size > 0) {
-					int cnt;
-					if (pHeader->size > CBUFFER_BYTES) cnt = CBUFFER_BYTES;
-					 else cnt = pHeader->size;
-					if (mpos + cnt > in->numBytes) WAV_FAILS("Failed to read data.")
-					memcpy(b.c, in->bytes + mpos, cnt);
-					mpos += cnt;
-					for (int i = 0; i < cnt / 3; i++) {
-						*f = ((b.c[i * 3] << 8) + (b.c[i * 3 + 1] << 16) + (b.c[i * 3 + 2] << 24)) / 2147483648.0f;
-						f++;
-					}
-					pHeader->size -= cnt;
-				}
-			} else if (snd->bitsPerSample == 32) {
-				snd->data.numBytes = pHeader->size;
-				snd->data.bytes = (uint8_t *)xm(snd->data.numBytes);
-				if (snd->data.bytes == NULL) WAV_FAILS("Failed on data allocation.")
-				float *f = (float*)snd->data.bytes;
-				wavConvertBuffer32 b;
-				while (pHeader->size > 0) {
-					int cnt;
-					if (pHeader->size > CBUFFER_MBYTES) cnt = CBUFFER_MBYTES;
-					 else cnt = pHeader->size;
-					if (mpos + cnt > in->numBytes) WAV_FAILS("Failed to read data.")
-					memcpy(b.c, in->bytes + mpos, cnt);
-					mpos += cnt;
-					for (int i = 0; i < cnt / 4; i++) {
-						*f = (float)b.c[i] / 2147483648.0f;
-						f++;
-					}
-					pHeader->size -= cnt;
-				}				
-			} else {
-				if (mpos + pHeader->size > in->numBytes) WAV_FAILS("File to read data.")
-				snd->data.bytes = (unsigned char *)xm(pHeader->size);
-				if (snd->data.bytes == NULL) WAV_FAILS("Failed on data allocation.")
-				memcpy(snd->data.bytes, in->bytes + mpos, pHeader->size);
-				snd->data.numBytes = pHeader->size;
-				mpos += pHeader->size;	
-			}
+		if (MATCH_FOURCC(chunk.id, "fmt ")) {
+			if (chunk.size < sizeof(wavFmtData)) WAV_FAILS("Badly formatted 'fmt ' chunk")
+			if (mpos + sizeof(wavFmtData) > in->numBytes) WAV_FAILS("Failed to read 'fmt_' chunk")
+			memcpy(&fmt, in->bytes + mpos, sizeof(fmt));
+			if (fmt.formatTag != 1) WAV_FAILS("File is not PCM")
+			if (!(fmt.bitsPerSample == 16 || fmt.bitsPerSample == 8 || fmt.bitsPerSample == 24
+				|| fmt.bitsPerSample == 32)) WAV_FAILS("File is unsupported bits per sample.")
+			if (fmt.channels == 0) WAV_FAILS("Badly formatted 'fmt ' chunk")
+			snd->channels = fmt.channels;
+			snd->sampleRate = fmt.sampleRate;
+			snd->bitsPerSample = fmt.bitsPerSample;
+			if (packed && snd->bitsPerSample >= 24) snd->bitsPerSample |= WAV_PACKED;
+			haveFmt = 1;
+		} else if (MATCH_FOURCC(chunk.id, "data") && *data == NULL) {
+			// a truncated file keeps what is there, like a short read
+			*data = in->bytes + mpos;
+			*dataSize = chunk.size;
+			if (*dataSize > in->numBytes - mpos) *dataSize = in->numBytes - mpos;
 		}
+		// chunks are padded to even sizes
+		if (chunk.size > in->numBytes - mpos) break;
+		mpos += chunk.size + (chunk.size & 1);
 	}
+	if (!haveFmt) WAV_FAILS("Missing 'fmt ' chunk")
+	if (*data == NULL) WAV_FAILS("Missing 'data' chunk")
 
 serr:
 	return err;
 }
+
+static const char* __attribute__((unused)) wav_load_memory(wavData *in, wavSound *snd, xmalloc xm, int32_t packed) {
+	const uint8_t *data;
+	size_t size;
+	const char *err;
+
+	if (xm == NULL) xm = malloc;
+
+	if ((err = wav_parse_memory(in, snd, &data, &size, packed)) != NULL) return err;
+	if (snd->bitsPerSample == 24 || snd->bitsPerSample == 32) {
+		size_t samples = size / (snd->bitsPerSample >> 3);
+
+		snd->data.numBytes = samples * 4;
+		snd->data.bytes = (uint8_t *)xm(snd->data.numBytes);
+		if (snd->data.bytes == NULL) return "Failed on data allocation.";
+		if (snd->bitsPerSample == 24)
+			wav_unpack24((float*)snd->data.bytes, data, samples);
+		else
+			wav_unpack32((float*)snd->data.bytes, data, samples);
+	} else {
+		snd->data.bytes = (uint8_t *)xm(size);
+		if (snd->data.bytes == NULL) return "Failed on data allocation.";
+		memcpy(snd->data.bytes, data, size);
+		snd->data.numBytes = size;
+	}
+	return NULL;
+}
+
+static const char* __attribute__((unused)) wavLoadMemory(wavData *in, wavSound *snd, xmalloc xm) {
+	return wav_load_memory(in, snd, xm, 0);
+}
+
+// 24 and 32 bit stay packed (WAV_S24, WAV_S32), no float copy is made
+static const char* __attribute__((unused)) wavLoadMemoryPacked(wavData *in, wavSound *snd, xmalloc xm) {
+	return wav_load_memory(in, snd, xm, 1);
+}
+
+// zero copy, snd->data points into in->bytes and is only valid while that is.
+// nothing is allocated, don't free it. 24 and 32 bit come back packed (WAV_S24,
+// WAV_S32) since the float layout would need a copy.
+static const char* __attribute__((unused)) wavLoadMemoryView(wavData *in, wavSound *snd) {
+	const uint8_t *data;
+	size_t size;
+	const char *err;
+
+	if ((err = wav_parse_memory(in, snd, &data, &size, 1)) != NULL) return err;
+	snd->data.bytes = (uint8_t*)data;
+	snd->data.numBytes = size;
+	return NULL;
+}
+
+// the same over a mapped file (wavioMmapOpen), the view lives until wavioMmapClose
+static const char* __attribute__((unused)) wavLoadView(wavVirtualIO *io, wavSound *snd) {
+	wavMmap *m = (wavMmap*)io->user;
+	wavData in;
+
+	if (io->read != wavio_mread) return "View needs a memory mapped file";
+	if (m == NULL) return "Failed to read RIFF header";
+	in.bytes = m->base;
+	in.numBytes = m->size;
+	return wavLoadMemoryView(&in, snd);
+}
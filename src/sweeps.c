@@ -8,9 +8,19 @@
 */
 
 #include "sweeps.h"
+#include "swsdsp.h"
+#include "swsfft.h"
+#include "swscache.h"
 #include <math.h>
 #include <memory.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
 
 #ifndef M_PI
 #define M_PI   3.14159265358979323846
@@ -22,18 +32,94 @@
 
 #define CHARSCALE				(1.0f / 128.0f)
 
-#define SIDELOBE_HEIGHT 		96
-#define UP_TRANSITION_WIDTH 	(1.0 / 32.0)
-#define DOWN_TRANSITION_WIDTH 	(1.0 / 128.0)
 #define MAX_SINC_WINDOW_SIZE 	2048
+#define MIN_SINC_WINDOW_SIZE 	8
 #define RESAMPLE_LUT_STEP 		128
+#define RESAMPLE_LUT_HALF 		(RESAMPLE_LUT_STEP / 2)
+#define LUT_FP16_MAX_DB 		70.0
+#define FIXED_MAX_DB 			70.0
+#define MAX_POLYPHASE_PHASES 	512
+#define HISTORY_WINDOWS 		2
+#define THREAD_CHUNK_FRAMES 	16384
+#define MAX_STAGES 			8
+#define CHAIN_FIFO_FRAMES 		4096
+#define SINC_PACK_FRAMES 		1024
+#define FFT_MAX_PHASES 			32
+#define FFT_MIN_SIZE 			512
+#define FFT_MAX_SIZE 			65536
+#define FFT_COST_WEIGHT 		7.5
+#define FFT_COST_FRAME 			42.0
+#define DIRECT_COST_FRAME 		140.0
+#define DIRECT_COST_INPUT 		36.0
+#define STAGE_COST_FRAME 		32.0
+
+// ******************************************************************************
+// stats, see swsStatsAttach(). with none attached every hook is one pointer test.
+
+static __thread swsStats *sinc_stats;
+
+void swsStatsAttach(swsStats *stats) {
+	sinc_stats = stats;
+}
+
+void swsStatsAdd(swsStats *to, const swsStats *from) {
+	to->readTime += from->readTime;
+	to->decodeTime += from->decodeTime;
+	to->lutTime += from->lutTime;
+	to->kernelTime += from->kernelTime;
+	to->convertTime += from->convertTime;
+	to->writeTime += from->writeTime;
+	to->framesIn += from->framesIn;
+	to->framesOut += from->framesOut;
+	to->bytesIn += from->bytesIn;
+	to->bytesOut += from->bytesOut;
+	to->allocations += from->allocations;
+	to->allocBytes += from->allocBytes;
+}
 
-typedef struct {
-	float value;
-	float delta;
-} lutEntry_t;
+double swsStatsClock(void) {
+	struct timespec t;
 
-lutEntry_t dynamicLut[RESAMPLE_LUT_STEP * MAX_SINC_WINDOW_SIZE];
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec * 0.000000001;
+}
+
+static inline double sinc_stats_clock(void) {
+	return sinc_stats ? swsStatsClock() : 0.0;
+}
+
+// the kernel is what a call spent less what it spent in decode and convert, so
+// start marks the clock with both taken off and end adds what has passed since
+static inline double sinc_kernel_start(void) {
+	return sinc_stats ? swsStatsClock() - sinc_stats->decodeTime - sinc_stats->convertTime : 0.0;
+}
+
+static inline void sinc_kernel_end(double start) {
+	if (sinc_stats)
+		sinc_stats->kernelTime += swsStatsClock() - sinc_stats->decodeTime - sinc_stats->convertTime - start;
+}
+
+static inline void sinc_stats_alloc(size_t bytes) {
+	if (sinc_stats) {
+		sinc_stats->allocations++;
+		sinc_stats->allocBytes += bytes;
+	}
+}
+
+static void* sinc_malloc(size_t bytes) {
+	sinc_stats_alloc(bytes);
+	return malloc(bytes);
+}
+
+static void* sinc_calloc(size_t n, size_t size) {
+	sinc_stats_alloc(n * size);
+	return calloc(n, size);
+}
+
+static void* sinc_realloc(void *p, size_t bytes) {
+	sinc_stats_alloc(bytes);
+	return realloc(p, bytes);
+}
 
 static inline uint32_t calc_gcd(uint32_t a, uint32_t b) {
 	while (b) {
@@ -45,567 +131,2229 @@ static inline uint32_t calc_gcd(uint32_t a, uint32_t b) {
 	return a;
 }
 
-static inline double exact_nsinc(double x) {
-	if (x == 0.0)
-		return 1.0;
-
-	return ((double)(M_1_PI) / x) * sin(M_PI * x);
-}
-
-// Modified Bessel function of the first kind, order 0
+// Modified Bessel function of the first kind, order 0, by its power series
+// sum (x / 2)^2k / k!^2, stopped once the terms no longer change a double. for
+// the betas a Kaiser design uses that is 20 to 40 terms instead of a fixed 89.
 // https://ccrma.stanford.edu/~jos/sasp/Kaiser_Window.html
 static inline double I0(double x) {
-	double r = 1.0, xx = x * x, xpow = xx, coeff = 0.25;
+	double r = 1.0, xx = x * x * 0.25, term = 1.0;
 	int32_t k;
 
-	// iterations until coeff ~= 0
-	// 19 for float32, 89 for float64, 880 for float80
-	for (k = 1; k < 89; k++)
+	for (k = 1; k < 500; k++)
 	{
-		r += xpow * coeff;
-		coeff /= (4 * k + 8) * k + 4;
-		xpow *= xx;
+		term *= xx / ((double)k * k);
+		r += term;
+		if (term < r * 1e-17) break;
 	}
 
 	return r;
 }
 
 // https://ccrma.stanford.edu/~jos/sasp/Kaiser_Window.html
-static inline double kaiser(int32_t n, int32_t length, double beta) {
-	double mid = 2 * n / (double)(length - 1) - 1.0;
+static void kaiser_window(double *w, int32_t length, double beta) {
+	double norm = 1.0 / I0(beta);
+	int32_t n;
+
+	for (n = 0; n < length; n++)
+	{
+		double mid = 2 * n / (double)(length - 1) - 1.0;
 
-	return I0(beta * sqrt(1.0 - mid * mid)) / I0(beta);
+		w[n] = I0(beta * sqrt(1.0 - mid * mid)) * norm;
+	}
 }
 
-static inline void sinc_resample_createLut(int32_t inFreq, int32_t cutoffFreq2, int32_t windowSize, double beta) {
-	double windowLut[windowSize];
-	double freqAdjust = (double)cutoffFreq2 / (double)inFreq;
-	lutEntry_t *out, *in;
-	int32_t i, j;
+// ******************************************************************************
+// table design. every row is the windowed sinc at one fractional offset, scaled
+// to unity gain. the sinc argument steps by a constant along a row, so sin(pi x)
+// is a rotation from tap to tap instead of a sin() call, reseeded exactly every
+// SINC_RESEED taps so rounding can't build up. rows don't depend on each other,
+// big tables are split across threads by row.
+
+#define SINC_RESEED 			64
+#define DESIGN_THREAD_TAPS		32768
+
+typedef struct _sincDesign {
+	const double *window;
+	float *rows;
+	int32_t lut;
+	double freqAdjust;
+	int32_t windowSize;
+	int32_t numRows;
+	int32_t threads;
+	int32_t thread;
+} sincDesign;
+
+static void sinc_design_row(const sincDesign *d, int32_t i, double *row) {
+	const int32_t windowSize = d->windowSize;
+	const double freqAdjust = d->freqAdjust;
+	const double ds = sin(M_PI * freqAdjust), dc = cos(M_PI * freqAdjust);
+	// bank row i is subpos i, lut rows run the other way across one input frame
+	double offset = d->lut ? i / (double)(RESAMPLE_LUT_STEP - 1) - windowSize / 2
+						: 1.0 - i / (double)d->numRows - windowSize / 2;
+	double sum = 0.0, sn = 0.0, cs = 0.0, t;
+	int32_t j;
+
+	for (j = 0; j < windowSize; j++)
+	{
+		double x = (j + offset) * freqAdjust;
 
-	for (i = 0; i < windowSize; i++)
-		windowLut[i] = kaiser(i, windowSize, beta);
+		if (j % SINC_RESEED == 0) {
+			sn = sin(M_PI * x);
+			cs = cos(M_PI * x);
+		}
+		row[j] = ((x == 0.0) ? 1.0 : sn * M_1_PI / x) * d->window[j];
+		sum += row[j];
 
-	out = dynamicLut;
-	for (i = 0; i < RESAMPLE_LUT_STEP; i++)
+		t = sn * dc + cs * ds;
+		cs = cs * dc - sn * ds;
+		sn = t;
+	}
+
+	for (j = 0; j < windowSize; j++)
+		d->rows[i * windowSize + j] = row[j] / sum;
+}
+
+static void* sinc_design_worker(void *arg) {
+	const sincDesign *d = arg;
+	double row[d->windowSize];
+	int32_t i;
+
+	// interleaved rows, every thread gets the same mix of work
+	for (i = d->thread; i < d->numRows; i += d->threads)
+		sinc_design_row(d, i, row);
+	return NULL;
+}
+
+static void sinc_design(float *rows, int32_t lut, int32_t numRows, int32_t inFreq, int32_t cutoffFreq2,
+						int32_t windowSize, double beta) {
+	double window[windowSize];
+	int32_t threads = swsCpuCount();
+	int32_t t;
+
+	if (threads > (int64_t)numRows * windowSize / DESIGN_THREAD_TAPS)
+		threads = (int64_t)numRows * windowSize / DESIGN_THREAD_TAPS;
+	if (threads < 1) threads = 1;
+
+	kaiser_window(window, windowSize, beta);
+
+	sincDesign d[threads];
+	pthread_t tid[threads];
+
+	for (t = 0; t < threads; t++)
+	{
+		d[t].window = window;
+		d[t].rows = rows;
+		d[t].lut = lut;
+		d[t].freqAdjust = (double)cutoffFreq2 / (double)inFreq;
+		d[t].windowSize = windowSize;
+		d[t].numRows = numRows;
+		d[t].threads = threads;
+		d[t].thread = t;
+	}
+	// the calling thread takes the first share itself
+	for (t = 1; t < threads; t++)
+	{
+		if (pthread_create(&tid[t], NULL, sinc_design_worker, &d[t]) != 0)
+			wavFatal("swsContextCreate() thread creation failure");
+	}
+	sinc_design_worker(&d[0]);
+	for (t = 1; t < threads; t++)
+		pthread_join(tid[t], NULL);
+}
+
+// ******************************************************************************
+// minimum phase design. the rows of a bank or a lut are all samples of one windowed
+// sinc, interleaved they are a single filter at R times the input rate, R the
+// phases of a bank or the lut's row step. that filter is designed whole, swapped
+// for the minimum phase filter with the same magnitude by folding its cepstrum,
+// and cut back into rows. sample m of it is m / R input frames late, bank row p tap
+// j is sample (windowSize - 1 - j) * R + p and lut row i tap j the same with
+// R - i for p, so the newest input frame meets the start of the response.
+// https://ccrma.stanford.edu/~jos/fp/Creating_Minimum_Phase_Filters.html
+
+// the cepstrum of a deep stopband decays slowly, the transform is this many times
+// longer than the filter so little of it wraps around
+#define MINPHASE_OVERSAMPLE		8
+// log of the magnitude is floored this far below the peak, 200 dB
+#define MINPHASE_FLOOR			1e-10
+
+static void sinc_design_minimum(float *rows, int32_t lut, int32_t numRows, int32_t inFreq, int32_t cutoffFreq2,
+						int32_t windowSize, double beta) {
+	const int32_t R = lut ? RESAMPLE_LUT_STEP - 1 : numRows;
+	const int32_t length = windowSize * R + 1;
+	const double freqAdjust = (double)cutoffFreq2 / (double)inFreq;
+	const double norm = 1.0 / I0(beta);
+	double *re, *im, peak = 0.0, least;
+	int32_t n = 1, m, i, j;
+
+	while (n < length * MINPHASE_OVERSAMPLE) n <<= 1;
+	re = sinc_calloc(n * 2, sizeof(double));
+	if (re == NULL) wavFatal("swsContextCreate() allocation failure");
+	im = re + n;
+
+	// the linear phase filter, centred windowSize / 2 frames in, the window continuous
+	for (m = 0; m < length; m++)
+	{
+		double x = windowSize * 0.5 - m / (double)R;
+		double mid = x / (windowSize * 0.5);
+		double a = x * freqAdjust;
+
+		re[m] = ((a == 0.0) ? 1.0 : sin(M_PI * a) * M_1_PI / a) * I0(beta * sqrt(fmax(0.0, 1.0 - mid * mid))) * norm;
+	}
+
+	// log magnitude, to the real cepstrum
+	if (!swsFftComplexD(re, im, n, 0)) wavFatal("swsContextCreate() allocation failure");
+	for (m = 0; m < n; m++)
+	{
+		re[m] = hypot(re[m], im[m]);
+		if (re[m] > peak) peak = re[m];
+	}
+	least = peak * MINPHASE_FLOOR;
+	for (m = 0; m < n; m++)
+	{
+		re[m] = log(fmax(re[m], least));
+		im[m] = 0.0;
+	}
+	if (!swsFftComplexD(re, im, n, 1)) wavFatal("swsContextCreate() allocation failure");
+
+	// fold the anticausal half onto the causal one, then back out through exp()
+	for (m = 0; m < n; m++)
+	{
+		re[m] *= (m == 0 || m == n / 2) ? 1.0 / n : (m < n / 2) ? 2.0 / n : 0.0;
+		im[m] = 0.0;
+	}
+	if (!swsFftComplexD(re, im, n, 0)) wavFatal("swsContextCreate() allocation failure");
+	for (m = 0; m < n; m++)
+	{
+		double e = exp(re[m]);
+
+		re[m] = e * cos(im[m]);
+		im[m] = e * sin(im[m]);
+	}
+	if (!swsFftComplexD(re, im, n, 1)) wavFatal("swsContextCreate() allocation failure");
+
+	// unity gain rows, as the linear phase design has
+	for (i = 0; i < numRows; i++)
 	{
-		double offset = i / (double)(RESAMPLE_LUT_STEP - 1) - windowSize / 2;
+		int32_t p = lut ? R - i : i;
 		double sum = 0.0;
-		for (j = 0; j < windowSize; j++)
-		{
-			double s = exact_nsinc((j + offset) * freqAdjust);
-			out->value = s * windowLut[j];
-			sum += s;
-			out++;
-		}
 
-		out -= windowSize;
 		for (j = 0; j < windowSize; j++)
+			sum += re[(windowSize - 1 - j) * R + p];
+		for (j = 0; j < windowSize; j++)
+			rows[i * windowSize + j] = re[(windowSize - 1 - j) * R + p] / sum;
+	}
+	free(re);
+}
+
+// the lut is symmetric, with an even window row RESAMPLE_LUT_STEP - 1 - i is row i
+// back to front. so only the first RESAMPLE_LUT_HALF rows are kept, all their values
+// and then all the deltas to the next row, as floats or fp16 when lut16 is set.
+// minimum phase has no symmetry, its lut keeps every row but the last.
+static inline int32_t sinc_lut_rows(int32_t minPhase) {
+	return minPhase ? RESAMPLE_LUT_STEP - 1 : RESAMPLE_LUT_HALF;
+}
+
+static inline size_t sinc_lut_bytes(int32_t windowSize, int32_t lut16, int32_t minPhase) {
+	return (size_t)sinc_lut_rows(minPhase) * windowSize * 2 * (lut16 ? sizeof(uint16_t) : sizeof(float));
+}
+
+static inline void sinc_resample_createLut(void *lut, int32_t lut16, int32_t minPhase, int32_t inFreq, int32_t cutoffFreq2,
+						int32_t windowSize, double beta) {
+	const int32_t n = sinc_lut_rows(minPhase) * windowSize;
+	// one row past the kept ones for the last delta
+	float *rows = sinc_malloc(sizeof(float) * (n + windowSize));
+	int32_t i;
+
+	if (rows == NULL) wavFatal("swsContextCreate() allocation failure");
+	if (minPhase)
+		sinc_design_minimum(rows, 1, sinc_lut_rows(minPhase) + 1, inFreq, cutoffFreq2, windowSize, beta);
+	else
+		sinc_design(rows, 1, RESAMPLE_LUT_HALF + 1, inFreq, cutoffFreq2, windowSize, beta);
+
+	if (lut16) {
+		uint16_t *value = lut, *delta = value + n;
+		uint16_t *half = sinc_malloc(sizeof(uint16_t) * (n + windowSize));
+
+		if (half == NULL) wavFatal("swsContextCreate() allocation failure");
+		// deltas between the rounded rows, so a row interpolated to 1 lands on the next
+		swsDspToHalf(half, rows, n + windowSize);
+		swsDspFromHalf(rows, half, n + windowSize);
+		memcpy(value, half, sizeof(uint16_t) * n);
+		for (i = 0; i < n; i++)
+			rows[i] = rows[i + windowSize] - rows[i];
+		swsDspToHalf(delta, rows, n);
+		free(half);
+	} else {
+		float *value = lut, *delta = value + n;
+
+		memcpy(value, rows, sizeof(float) * n);
+		for (i = 0; i < n; i++)
+			delta[i] = rows[i + windowSize] - rows[i];
+	}
+	free(rows);
+}
+
+// exact coefficients for every output phase, used when the reduced ratio has few
+// enough phases. row p is the filter for subpos p, so the kernel needs no
+// interpolation between lut rows.
+static inline void sinc_resample_createBank(float *bank, int32_t phases, int32_t minPhase, int32_t inFreq, int32_t cutoffFreq2,
+						int32_t windowSize, double beta) {
+	if (minPhase)
+		sinc_design_minimum(bank, 0, phases, inFreq, cutoffFreq2, windowSize, beta);
+	else
+		sinc_design(bank, 0, phases, inFreq, cutoffFreq2, windowSize, beta);
+}
+
+// 16 bit copy of a bank for the fixed point kernel, returns the scale back to
+// float. one gain for the whole table, as large as 16 bit taps allow but small
+// enough that no row can overflow the 32 bit sum over full scale input. rounding
+// error is then around -75 dB. each row is nudged at its centre tap so it still
+// sums to exactly the gain, or the phases would differ in level.
+static float sinc_resample_createFixed(int16_t *fixed, const float *bank, int32_t phases, int32_t windowSize) {
+	double peak = 0.0, norm = 0.0, gain;
+	int32_t p, i;
+
+	for (p = 0; p < phases; p++)
+	{
+		const float *row = bank + p * windowSize;
+		double sum = 0.0;
+
+		for (i = 0; i < windowSize; i++)
 		{
-			out->value /= sum;
-			out++;
+			sum += fabs(row[i]);
+			if (fabs(row[i]) > peak) peak = fabs(row[i]);
 		}
+		if (sum > norm) norm = sum;
 	}
+	// 32768 * (gain * norm + windowSize / 2) stays under 2^31 with rounding
+	gain = (65536.0 - windowSize) / norm;
+	if (gain > 32000.0 / peak) gain = 32000.0 / peak;
+	gain = floor(gain);
 
-	out = dynamicLut;
-	in = out + windowSize;
-	for (i = 0; i < RESAMPLE_LUT_STEP - 1; i++)
+	for (p = 0; p < phases; p++)
 	{
-		for (j = 0; j < windowSize; j++)
+		const float *row = bank + p * windowSize;
+		int16_t *out = fixed + p * windowSize;
+		int32_t sum = 0, centre = 0;
+
+		for (i = 0; i < windowSize; i++)
 		{
-			out->delta = in->value - out->value;
-			out++;
-			in++;
+			out[i] = lrint(row[i] * gain);
+			sum += out[i];
+			if (abs(out[i]) > abs(out[centre])) centre = i;
 		}
+		out[centre] += (int32_t)gain - sum;
 	}
+	return 1.0f / gain;
+}
 
-	for (j = 0; j < windowSize; j++)
-	{
-		out->delta = 0;
-		out++;
+// ******************************************************************************
+// quality, the filter design parameters
+
+void swsQualityPreset(swsQuality *q, int32_t preset) {
+	switch (preset) {
+		case SWS_QUALITY_DRAFT:
+			q->attenuation = 40.0;
+			q->upTransition = 1.0 / 8.0;
+			q->downTransition = 1.0 / 16.0;
+			break;
+		case SWS_QUALITY_VOICE:
+			q->attenuation = 60.0;
+			q->upTransition = 1.0 / 16.0;
+			q->downTransition = 1.0 / 32.0;
+			break;
+		case SWS_QUALITY_BROADCAST:
+			q->attenuation = 80.0;
+			q->upTransition = 1.0 / 24.0;
+			q->downTransition = 1.0 / 64.0;
+			break;
+		default:
+			q->attenuation = 96.0;
+			q->upTransition = 1.0 / 32.0;
+			q->downTransition = 1.0 / 128.0;
+			break;
 	}
+	q->minPhase = 0;
 }
 
-#define CUINT8TOF(x)	((float)x - 128.0f)
-static inline void sinc_resample8_internal(uint8_t *wavOut, int32_t sizeOut, int32_t outFreq, 
-						const uint8_t *wavIn, int32_t sizeIn, int32_t inFreq, int32_t cutoffFreq2,
-						int32_t numChannels, int32_t windowSize, double beta) {
-	float y[windowSize * numChannels];
-	const uint8_t *sampleIn, *wavInEnd = wavIn + sizeIn;
-	uint8_t *sampleOut, *wavOutEnd = wavOut + sizeOut;
-	float outPeriod;
-	int subpos = 0;
-	int gcd = calc_gcd(inFreq, outFreq);
-	int i, c, next;
-	float dither[numChannels];
+// kaiser window length and beta for a stopband attenuation in dB and a transition
+// width as a fraction of the filter's input rate
+static void sinc_resample_design(double sidelobeHeight, double transitionWidth, int32_t *windowSize, double *beta) {
+	// https://www.mathworks.com/help/signal/ug/kaiser-window.html
+	*beta = 0.0;
+	if (sidelobeHeight > 50)
+		*beta = 0.1102 * (sidelobeHeight - 8.7);
+	else if (sidelobeHeight >= 21)
+		*beta = 0.5842 * pow(sidelobeHeight - 21.0, 0.4) + 0.07886 * (sidelobeHeight - 21.0);
 
-	sinc_resample_createLut(inFreq, cutoffFreq2, windowSize, beta);
+	*windowSize = (sidelobeHeight - 8.0) / (2.285 * transitionWidth * M_PI) + 1;
 
-	inFreq /= gcd;
-	outFreq /= gcd;
-	outPeriod = 1.0f / outFreq;
+	if (*windowSize > MAX_SINC_WINDOW_SIZE)
+		*windowSize = MAX_SINC_WINDOW_SIZE;
+	if (*windowSize < MIN_SINC_WINDOW_SIZE)
+		*windowSize = MIN_SINC_WINDOW_SIZE;
+}
 
-	for (c = 0; c < numChannels; c++)
-		dither[c] = 0.0f;
+// ******************************************************************************
+// stage planning. a large ratio is cheaper as a cascade of 2:1 stages and one
+// fractional stage. the 2:1 stages only have to keep their aliases (or images)
+// out of the band the final output keeps, so their transitions are wide and their
+// filters short, and the sharp fractional filter runs at the lowest rate in the
+// chain. the plan with the lowest cost per output frame wins, counted in direct
+// kernel taps: the taps themselves, what every frame a stage makes or takes in
+// costs around them, and the hand-off of each frame between two stages. the
+// per frame costs were fitted to timings of every rate pair, preset and forced
+// plan on 2 and 6 channels, they are what makes short filters in a cascade
+// dearer than their tap count says.
+// the kaiser length estimate is optimistic for very short filters and the ripple
+// of the stages adds up, so the 2:1 stages get a little extra attenuation.
+
+#define CASCADE_MARGIN_DB		20.0
+
+typedef struct _sincPlan {
+	int32_t inFreq;
+	int32_t outFreq;
+	int32_t cutoffFreq2;
+	int32_t windowSize;
+	int32_t fftSize;
+	int32_t lut;
+	int32_t lut16;
+	int32_t fixed;
+	double beta;
+} sincPlan;
+
+// cost per output frame of an overlap-save stage: I forward and O inverse transforms
+// plus I * O spectrum products per block of block * O output frames, plus the
+// gather and scatter around them
+static double sinc_fft_cost(int32_t size, int32_t taps, int32_t inStep, int32_t outStep) {
+	int32_t block = size - taps + 1;
+
+	return FFT_COST_WEIGHT * ((inStep + outStep) * size * log2(size) + 2.0 * inStep * outStep * size + inStep * size)
+			/ ((double)block * outStep) + FFT_COST_FRAME;
+}
 
-	for (i = 0; i < windowSize / 2 - 1; i++)
-	{
-		for (c = 0; c < numChannels; c++)
-			y[i * numChannels + c] = 0;
+// fill in one stage, returns its cost per output frame of the chain
+static double sinc_plan_stage(sincPlan *p, int32_t inFreq, int32_t outFreq, double cutoffFreq2, double transitionWidth,
+						double attenuation, int32_t chainFreq, int32_t minPhase, int32_t force) {
+	int32_t gcd = calc_gcd(inFreq, outFreq);
+	int32_t inStep = inFreq / gcd, phases = outFreq / gcd;
+	double cost, c;
+	int32_t taps, size;
+
+	p->inFreq = inFreq;
+	p->outFreq = outFreq;
+	p->cutoffFreq2 = cutoffFreq2;
+
+	// FIXME: Figure out why there are bad effects with cutoffFreq2 > inFreq
+	if (p->cutoffFreq2 > inFreq)
+		p->cutoffFreq2 = inFreq;
+
+	sinc_resample_design(attenuation, transitionWidth, &p->windowSize, &p->beta);
+
+	// lut stages keep half the table and mirror the rest, which needs an even window.
+	// fp16 rounding sits around -75 dB, so halve the table again when the design
+	// doesn't reject more than that anyway.
+	p->lut = phases > MAX_POLYPHASE_PHASES || (force & SWS_FORCE_LUT);
+	p->lut16 = 0;
+	if (p->lut) {
+		p->windowSize += p->windowSize & 1;
+		p->lut16 = (force & SWS_FORCE_LUT16) || (!(force & SWS_FORCE_LUT32) && attenuation <= LUT_FP16_MAX_DB);
 	}
 
-	sampleIn = wavIn;
-	for (; i < windowSize; i++)
-	{
-		for (c = 0; c < numChannels; c++) {
-			float v = CUINT8TOF(*sampleIn);
-			y[i * numChannels + c] = (sampleIn++ < wavInEnd) ? v : 0;
+	// 16 bit coefficients hold about as much as fp16 does, bank stages under the
+	// same bar can also run the fixed point kernel on 8 and 16 bit input
+	p->fixed = !p->lut && ((force & SWS_FORCE_FIXED) || (!(force & SWS_FORCE_FLOAT) && attenuation <= FIXED_MAX_DB));
+
+	// lut stages also interpolate every row of coefficients
+	cost = p->windowSize * (p->lut ? 2 : 1) + DIRECT_COST_FRAME + DIRECT_COST_INPUT * inStep / phases;
+
+	// overlap-save when the ratio is simple and the filter long enough to pay off,
+	// never for minimum phase, waiting for a whole block would undo its point
+	p->fftSize = 0;
+	if (!p->lut && !minPhase && !(force & SWS_FORCE_DIRECT) && inStep * phases <= FFT_MAX_PHASES) {
+		taps = (p->windowSize + inStep * 2 - 2) / inStep;
+		for (size = FFT_MIN_SIZE; size <= FFT_MAX_SIZE; size <<= 1)
+		{
+			if (size < taps * 2) continue;
+			c = sinc_fft_cost(size, taps, inStep, phases);
+			if (c < cost) {
+				cost = c;
+				p->fftSize = size;
+			}
 		}
 	}
+	return cost * outFreq / chainFreq;
+}
 
-	sampleOut = wavOut;
-	next = 0;
-	while (sampleOut < wavOutEnd)
+static int32_t sinc_plan(sincPlan *plan, int32_t inFreq, int32_t outFreq, const swsQuality *q, int32_t force) {
+	sincPlan cand[MAX_STAGES];
+	double attenuation = q->attenuation;
+	double halfband = attenuation + CASCADE_MARGIN_DB;
+	double transitionWidth = (outFreq > inFreq) ? q->upTransition : q->downTransition;
+	double best, cost, pass, stop, edge;
+	int32_t numStages = 1, n, k, i, f;
+
+	// cutoff freq is ideally half transition width away from output freq. the single
+	// stage also fixes the band every cascade has to keep, pass to stop in Hz.
+	best = sinc_plan_stage(&plan[0], inFreq, outFreq, outFreq - transitionWidth * inFreq * 0.5, transitionWidth,
+						attenuation, outFreq, q->minPhase, force);
+	pass = plan[0].cutoffFreq2 * 0.5 - transitionWidth * inFreq * 0.25;
+	stop = plan[0].cutoffFreq2 * 0.5 + transitionWidth * inFreq * 0.25;
+
+	for (k = 1; k < MAX_STAGES && !(force & SWS_FORCE_SINGLE); k++)
 	{
-		float samples[numChannels];
-		float offset = 1.0f - subpos * outPeriod;
-		float interp;
-		lutEntry_t *lutPart;
-		int index;
+		cost = 0.0;
+		n = 0;
+		if (outFreq < inFreq) {
+			// k halvings, then the fractional step down
+			f = inFreq >> k;
+			if ((inFreq & ((1 << k) - 1)) || f < outFreq) break;
+			for (i = 0; i < k; i++)
+			{
+				int32_t from = inFreq >> i;
+
+				// anything above edge would alias below stop once halved
+				edge = (from >> 1) - stop;
+				if (edge <= pass) break;
+				cost += sinc_plan_stage(&cand[n++], from, from >> 1, pass + edge, 2.0 * (edge - pass) / from, halfband, outFreq, q->minPhase, force);
+			}
+			if (i < k) break;
+			if (f != outFreq)
+				cost += sinc_plan_stage(&cand[n++], f, outFreq, pass + stop, 2.0 * (stop - pass) / f, attenuation, outFreq, q->minPhase, force);
+		} else {
+			// the fractional step up first, then k doublings
+			f = outFreq >> k;
+			if ((outFreq & ((1 << k) - 1)) || f < inFreq) break;
+			edge = inFreq * 0.5;
+			if (f != inFreq) {
+				cost += sinc_plan_stage(&cand[n++], inFreq, f, f - transitionWidth * inFreq * 0.5, transitionWidth, attenuation, outFreq, q->minPhase, force);
+				// never narrower than the single stage
+				if (cand[0].cutoffFreq2 < plan[0].cutoffFreq2) break;
+				edge = cand[0].cutoffFreq2 * 0.5 + transitionWidth * inFreq * 0.25;
+			}
+			for (i = 0; i < k; i++)
+			{
+				int32_t from = f << i;
+
+				// the first image starts at from - edge
+				if (from - edge <= pass) break;
+				cost += sinc_plan_stage(&cand[n++], from, from << 1, pass + from - edge, 2.0 * (from - edge - pass) / from,
+								halfband, outFreq, q->minPhase, force);
+			}
+			if (i < k) break;
+		}
 
-		for (c = 0; c < numChannels; c++)
-			samples[c] = 0.0f;
+		// every frame but the last stage's goes through a fifo to the next
+		for (i = 0; i < n - 1; i++)
+			cost += STAGE_COST_FRAME * cand[i].outFreq / outFreq;
 
-		interp = offset * (RESAMPLE_LUT_STEP - 1);
-		index = interp;
-		interp -= index;
-		lutPart = dynamicLut + index * windowSize;
+		// one stage is the single stage design again
+		if (n > 1 && cost < best) {
+			best = cost;
+			numStages = n;
+			memcpy(plan, cand, sizeof(sincPlan) * n);
+		}
+	}
 
-		for (i = next; i < windowSize; i++, lutPart++)
-		{
-			float scale = lutPart->value + lutPart->delta * interp;
+	return numStages;
+}
 
-			for (c = 0; c < numChannels; c++)
-				samples[c] += y[i * numChannels + c] * scale;
+// ******************************************************************************
+// contexts, the designed filters for one rate pair. read only once created so any
+// number of threads can share one.
+
+typedef struct _sincStage {
+	// the half lut (every row for minimum phase) as values then deltas, only one
+	// pair of pointers is set
+	const void *lut;
+	const float *lutValue;
+	const float *lutDelta;
+	const uint16_t *lut16Value;
+	const uint16_t *lut16Delta;
+	const float *bank;
+	// fixed point copy of the bank for the first stage, times fixedScale is float
+	int16_t *bankFixed;
+	float fixedScale;
+	swsFft *fft;
+	const float *fftRe;
+	const float *fftIm;
+	// set when the table above came from the on disk cache instead of malloc
+	swsCacheMap lutMap;
+	swsCacheMap bankMap;
+	swsCacheMap fftMap;
+	int32_t fftSize;
+	int32_t fftTaps;
+	int32_t fftBlock;
+	int32_t inFreq;
+	int32_t outFreq;
+	int32_t inStep;
+	int32_t outStep;
+	int32_t windowSize;
+	// input frames of history before an output frame's own, windowSize / 2 - 1 so
+	// the window is centred on it, windowSize - 1 for minimum phase
+	int32_t lead;
+	int32_t minPhase;
+	// see swsContextLatency(), in this stage's input frames. the input past an
+	// output frame's own the stage needs to make it and the group delay at DC,
+	// 0 for linear phase.
+	int32_t lookahead;
+	double delay;
+	float outPeriod;
+} sincStage;
+
+struct _swsContext {
+	const swsDsp *dsp;
+	int32_t inFreq;
+	int32_t outFreq;
+	int32_t inStep;
+	int32_t outStep;
+	// made by swsContextCreateVariable(), one lut stage even when the rates match
+	int32_t variable;
+	int32_t numStages;
+	sincStage stages[MAX_STAGES];
+};
+
+// ******************************************************************************
+// overlap-save stages. with I = inStep and O = outStep, output frame qO + s uses
+// bank row sI % O at input frame qI + sI / O, so each slot s is one filter run
+// over the input at stride I. split into the I polyphase input streams that is a
+// sum of I plain correlations per slot, done by FFT for a block of q at a time.
+// blocks sit on a fixed grid of output frames, so a seek lands on the same block
+// the sequential path computes and the result stays bit identical.
+
+// the slot filters, reversed so the convolution is a correlation and scaled for
+// the unscaled inverse, then transformed. re and im spectra share one table.
+static void sinc_fft_create(sincStage *s, int32_t size, const swsDsp *dsp, swsCacheKey *key) {
+	const int32_t inStep = s->inStep, outStep = s->outStep, windowSize = s->windowSize;
+	const int32_t bins = size / 2 + 1;
+	const size_t bytes = sizeof(float) * bins * inStep * outStep * 2;
+	const float *table;
+	float *re, *im, *g, *work;
+	int32_t slot, r, i;
+
+	s->fft = swsFftCreate(size, dsp);
+	if (s->fft == NULL) wavFatal("swsContextCreate() allocation failure");
+	s->fftSize = size;
+	s->fftTaps = (windowSize + inStep * 2 - 2) / inStep;
+	s->fftBlock = size - s->fftTaps + 1;
+
+	// spectra depend on the butterflies that made them, key on the dsp level too
+	key->type = SWS_CACHE_FFT;
+	key->size = size;
+	key->level = dsp->level;
+	table = swsCacheLoad(key, bytes, &s->fftMap);
+	if (table == NULL) {
+		re = sinc_malloc(bytes);
+		g = sinc_malloc(sizeof(float) * size);
+		work = sinc_malloc(sizeof(float) * swsFftWorkSize(size));
+		if (re == NULL || g == NULL || work == NULL)
+			wavFatal("swsContextCreate() allocation failure");
+		im = re + bins * inStep * outStep;
+
+		for (slot = 0; slot < outStep; slot++)
+		{
+			const float *h = s->bank + (slot * inStep % outStep) * windowSize;
+			int32_t d = slot * inStep / outStep;
+
+			for (r = 0; r < inStep; r++)
+			{
+				memset(g, 0, sizeof(float) * size);
+				for (i = 0; i < s->fftTaps; i++)
+				{
+					int32_t j = i * inStep + r - d;
+
+					if (j >= 0 && j < windowSize)
+						g[s->fftTaps - 1 - i] = h[j] / size;
+				}
+				swsFftForward(s->fft, g, re + (slot * inStep + r) * bins, im + (slot * inStep + r) * bins, work);
+			}
 		}
 
-		for (i = 0; i < next; i++, lutPart++)
-		{
-			float scale = lutPart->value + lutPart->delta * interp;
+		free(g);
+		free(work);
+		swsCacheStore(key, re, bytes);
+		table = re;
+	}
+	s->fftRe = table;
+	s->fftIm = table + bins * inStep * outStep;
+}
 
-			for (c = 0; c < numChannels; c++)
-				samples[c] += y[i * numChannels + c] * scale;
-		}
+// a table either mapped from the cache or our own allocation
+static void sinc_table_free(const void *table, swsCacheMap *map) {
+	if (map->base == NULL)
+		free((void*)table);
+	swsCacheUnmap(map);
+}
 
-		for (c = 0; c < numChannels; c++)
-		{
-			float r = roundf(samples[c] + dither[c]);
-			dither[c] += samples[c] - r;
+void swsSetCacheDir(const char *dir) {
+	swsCacheSetDir(dir);
+}
 
-			if (r > 127)
-				*sampleOut++ = 255;
-			else if (r < -128)
-				*sampleOut++ = 0;
-			else
-				*sampleOut++ = (uint8_t)(r + 128);
-		}
+// row i of a minimum phase lut as floats, the row past the last kept one is that
+// row plus its delta
+static void sinc_lut_row(const sincStage *s, int32_t i, float *row, float *delta) {
+	const int32_t windowSize = s->windowSize;
+	const int32_t k = (i < RESAMPLE_LUT_STEP - 1) ? i : RESAMPLE_LUT_STEP - 2;
+	int32_t j;
+
+	if (s->lut16Value != NULL) {
+		swsDspFromHalf(row, s->lut16Value + k * windowSize, windowSize);
+		swsDspFromHalf(delta, s->lut16Delta + k * windowSize, windowSize);
+	} else {
+		memcpy(row, s->lutValue + k * windowSize, sizeof(float) * windowSize);
+		memcpy(delta, s->lutDelta + k * windowSize, sizeof(float) * windowSize);
+	}
+	if (k < i) {
+		for (j = 0; j < windowSize; j++)
+			row[j] += delta[j];
+	}
+}
 
-		subpos += inFreq;
-		while (subpos >= outFreq)
+// group delay at DC of a minimum phase stage, measured on the table the kernel runs
+// so it holds for a cached one too. every row sums to one, so it is the mean over
+// the phases of each row's centroid, tap j of a row at fraction f being
+// f + windowSize - 1 - j input frames late. lut rows run from f = 1 at row 0 down to
+// f = 0 a step past the last kept row, the kernel interpolates between them so the
+// mean is over the intervals.
+static double sinc_stage_delay(const sincStage *s) {
+	const int32_t windowSize = s->windowSize;
+	float row[windowSize], delta[windowSize];
+	double total = 0.0, centre, f;
+	int32_t i, j;
+
+	if (s->bank != NULL) {
+		for (i = 0; i < s->outStep; i++)
 		{
-			subpos -= outFreq;
+			f = i / (double)s->outStep;
+			for (centre = 0.0, j = 0; j < windowSize; j++)
+				centre += s->bank[i * windowSize + j] * (f + windowSize - 1 - j);
+			total += centre;
+		}
+		return total / s->outStep;
+	}
+	for (i = 0; i < RESAMPLE_LUT_STEP; i++)
+	{
+		f = 1.0 - i / (double)(RESAMPLE_LUT_STEP - 1);
+		sinc_lut_row(s, i, row, delta);
+		for (centre = 0.0, j = 0; j < windowSize; j++)
+			centre += row[j] * (f + windowSize - 1 - j);
+		total += (i == 0 || i == RESAMPLE_LUT_STEP - 1) ? centre * 0.5 : centre;
+	}
+	return total / (RESAMPLE_LUT_STEP - 1);
+}
 
-			for (c = 0; c < numChannels; c++) {
-				float v = CUINT8TOF(*sampleIn);
-				y[next * numChannels + c] = (sampleIn++ < wavInEnd) ? v : 0;
+static swsContext* sinc_context_create(int32_t inFreq, int32_t outFreq, const swsQuality *quality, int32_t force,
+						int32_t variable) {
+	swsContext *ctx = sinc_calloc(1, sizeof(swsContext));
+	int32_t gcd = calc_gcd(inFreq, outFreq);
+	sincPlan plan[MAX_STAGES];
+	swsCacheKey key;
+	swsQuality q;
+	size_t bytes;
+	int32_t i;
+
+	if (ctx == NULL) wavFatal("swsContextCreate() allocation failure");
+	if (quality == NULL)
+		swsQualityPreset(&q, SWS_QUALITY_MASTERING);
+	else
+		q = *quality;
+	if (q.attenuation < 21.0 || q.upTransition <= 0.0 || q.downTransition <= 0.0
+		|| q.upTransition >= 1.0 || q.downTransition >= 1.0) wavFatal("swsContextCreate() invalid quality");
+	ctx->inFreq = inFreq;
+	ctx->outFreq = outFreq;
+	ctx->inStep = inFreq / gcd;
+	ctx->outStep = outFreq / gcd;
+	ctx->variable = variable;
+	ctx->dsp = swsDspBest();
+	if ((force >> 8) && swsDspLevel((force >> 8) - 1) != NULL)
+		ctx->dsp = swsDspLevel((force >> 8) - 1);
+
+	// Just copy if no resampling necessary, a variable ratio can leave the match
+	if (inFreq == outFreq && !variable)
+		return ctx;
+
+	ctx->numStages = sinc_plan(plan, inFreq, outFreq, &q, force);
+	for (i = 0; i < ctx->numStages; i++)
+	{
+		sincStage *s = &ctx->stages[i];
+
+		gcd = calc_gcd(plan[i].inFreq, plan[i].outFreq);
+		s->inFreq = plan[i].inFreq;
+		s->outFreq = plan[i].outFreq;
+		s->inStep = s->inFreq / gcd;
+		s->outStep = s->outFreq / gcd;
+		s->outPeriod = 1.0f / s->outStep;
+		s->windowSize = plan[i].windowSize;
+		s->minPhase = q.minPhase;
+		s->lead = q.minPhase ? s->windowSize - 1 : s->windowSize / 2 - 1;
+
+		memset(&key, 0, sizeof(key));
+		key.inFreq = s->inFreq;
+		key.outFreq = s->outFreq;
+		key.cutoffFreq2 = plan[i].cutoffFreq2;
+		key.windowSize = s->windowSize;
+		key.beta = plan[i].beta;
+
+		// a polyphase bank when the ratio has few phases, else the interpolated lut.
+		// either is mapped from the cache when this design was seen before.
+		if (!plan[i].lut) {
+			key.type = q.minPhase ? SWS_CACHE_BANK_MIN : SWS_CACHE_BANK;
+			key.size = s->outStep;
+			bytes = sizeof(float) * s->outStep * s->windowSize;
+			s->bank = swsCacheLoad(&key, bytes, &s->bankMap);
+			if (s->bank == NULL) {
+				float *bank = sinc_malloc(bytes);
+
+				if (bank == NULL) wavFatal("swsContextCreate() allocation failure");
+				sinc_resample_createBank(bank, s->outStep, q.minPhase, s->inFreq, plan[i].cutoffFreq2, s->windowSize, plan[i].beta);
+				swsCacheStore(&key, bank, bytes);
+				s->bank = bank;
+			}
+			// only the first stage ever sees integer input, it's quick to derive
+			if (i == 0 && plan[i].fixed && plan[i].fftSize == 0) {
+				s->bankFixed = sinc_malloc(sizeof(int16_t) * s->outStep * s->windowSize);
+				if (s->bankFixed == NULL) wavFatal("swsContextCreate() allocation failure");
+				s->fixedScale = sinc_resample_createFixed(s->bankFixed, s->bank, s->outStep, s->windowSize);
+			}
+		} else {
+			if (q.minPhase)
+				key.type = plan[i].lut16 ? SWS_CACHE_LUT16_MIN : SWS_CACHE_LUT_MIN;
+			else
+				key.type = plan[i].lut16 ? SWS_CACHE_LUT16 : SWS_CACHE_LUT;
+			key.size = RESAMPLE_LUT_STEP;
+			bytes = sinc_lut_bytes(s->windowSize, plan[i].lut16, q.minPhase);
+			s->lut = swsCacheLoad(&key, bytes, &s->lutMap);
+			if (s->lut == NULL) {
+				void *lut = sinc_malloc(bytes);
+
+				if (lut == NULL) wavFatal("swsContextCreate() allocation failure");
+				sinc_resample_createLut(lut, plan[i].lut16, q.minPhase, s->inFreq, plan[i].cutoffFreq2, s->windowSize, plan[i].beta);
+				swsCacheStore(&key, lut, bytes);
+				s->lut = lut;
+			}
+			if (plan[i].lut16) {
+				s->lut16Value = s->lut;
+				s->lut16Delta = s->lut16Value + sinc_lut_rows(q.minPhase) * s->windowSize;
+			} else {
+				s->lutValue = s->lut;
+				s->lutDelta = s->lutValue + sinc_lut_rows(q.minPhase) * s->windowSize;
 			}
-
-			next = (next + 1) % windowSize;
 		}
+		if (plan[i].fftSize > 0)
+			sinc_fft_create(s, plan[i].fftSize, ctx->dsp, &key);
+		s->lookahead = (s->fft != NULL ? s->fftSize * s->inStep : s->windowSize) - 1 - s->lead;
+		s->delay = s->minPhase ? sinc_stage_delay(s) : 0.0;
 	}
+	return ctx;
 }
 
-static inline void sinc_resample16_internal(int16_t *wavOut, int32_t sizeOut, int32_t outFreq, 
-						const int16_t *wavIn, int32_t sizeIn, int32_t inFreq, int32_t cutoffFreq2,
-						int32_t numChannels, int32_t windowSize, double beta) {
-	float y[windowSize * numChannels];
-	const int16_t *sampleIn, *wavInEnd = wavIn + (sizeIn / 2);
-	int16_t *sampleOut, *wavOutEnd = wavOut + (sizeOut / 2);
-	float outPeriod;
-	int subpos = 0;
-	int gcd = calc_gcd(inFreq, outFreq);
-	int i, c, next;
-	float dither[numChannels];
+static swsContext* sinc_context_timed(int32_t inFreq, int32_t outFreq, const swsQuality *quality, int32_t force,
+						int32_t variable) {
+	double start = sinc_stats_clock();
+	swsContext *ctx = sinc_context_create(inFreq, outFreq, quality, force, variable);
 
-	sinc_resample_createLut(inFreq, cutoffFreq2, windowSize, beta);
+	if (sinc_stats)
+		sinc_stats->lutTime += swsStatsClock() - start;
+	return ctx;
+}
 
-	inFreq /= gcd;
-	outFreq /= gcd;
-	outPeriod = 1.0f / outFreq;
+swsContext* swsContextCreateForced(int32_t inFreq, int32_t outFreq, const swsQuality *quality, int32_t force) {
+	return sinc_context_timed(inFreq, outFreq, quality, force, 0);
+}
 
-	for (c = 0; c < numChannels; c++)
-		dither[c] = 0.0f;
+// the lut interpolates a row for any position between input frames, the bank only
+// has the rows of the reduced ratio, and a cascade or overlap-save stage is tied
+// to it too
+swsContext* swsContextCreateVariable(int32_t inFreq, int32_t outFreq, const swsQuality *quality) {
+	return sinc_context_timed(inFreq, outFreq, quality, SWS_FORCE_SINGLE | SWS_FORCE_DIRECT | SWS_FORCE_LUT, 1);
+}
 
-	for (i = 0; i < windowSize / 2 - 1; i++)
+swsContext* swsContextCreate(int32_t inFreq, int32_t outFreq, const swsQuality *quality) {
+	return swsContextCreateForced(inFreq, outFreq, quality, 0);
+}
+
+// each stage counts in its own input frames, a stage further down the chain runs at
+// another rate. a stream also never makes more output than the whole buffer would
+// from the input so far, which holds each frame back up to one output frame. a
+// plain copy has no stages and no latency.
+double swsContextLatency(const swsContext *ctx) {
+	double lookahead = 0.0, delay = 0.0;
+	int32_t i;
+
+	if (ctx->numStages == 0)
+		return 0.0;
+	for (i = 0; i < ctx->numStages; i++)
 	{
-		for (c = 0; c < numChannels; c++)
-			y[i * numChannels + c] = 0;
+		lookahead += (double)ctx->stages[i].lookahead * ctx->inFreq / ctx->stages[i].inFreq;
+		delay += ctx->stages[i].delay * ctx->inFreq / ctx->stages[i].inFreq;
 	}
+	if (lookahead < (double)ctx->inStep / ctx->outStep)
+		lookahead = (double)ctx->inStep / ctx->outStep;
+	return lookahead + delay;
+}
+
+void swsContextFree(swsContext *ctx) {
+	int32_t i;
 
-	sampleIn = wavIn;
-	for (; i < windowSize; i++)
+	if (ctx == NULL) return;
+	for (i = 0; i < ctx->numStages; i++)
 	{
-		for (c = 0; c < numChannels; c++)
-			y[i * numChannels + c] = (sampleIn < wavInEnd) ? *sampleIn++ : 0;
+		sincStage *s = &ctx->stages[i];
+
+		sinc_table_free(s->lut, &s->lutMap);
+		sinc_table_free(s->bank, &s->bankMap);
+		free(s->bankFixed);
+		sinc_table_free(s->fftRe, &s->fftMap);
+		swsFftFree(s->fft);
 	}
+	free(ctx);
+}
 
-	sampleOut = wavOut;
-	next = 0;
-	while (sampleOut < wavOutEnd)
-	{
-		float samples[numChannels];
-		float offset = 1.0f - subpos * outPeriod;
-		float interp;
-		lutEntry_t *lutPart;
-		int index;
+// ******************************************************************************
+// resampler state, everything the kernel needs to carry between calls
+
+typedef struct _sincState {
+	const swsDsp *dsp;
+	const sincStage *stage;
+	float *y;
+	// the history for the fixed point kernel, set instead of y
+	int16_t *yFixed;
+	float *h;
+	float *dither;
+	int32_t numChannels;
+	int32_t bits;
+	int32_t outBits;
+	// scales the filtered sum from the input's sample range to the output's
+	float gain;
+	int32_t planar;
+	int32_t c0;
+	int32_t c1;
+	int32_t subpos;
+	int32_t pos;
+	int32_t pending;
+	// variable ratio states keep their place within the input frame as a 64 bit
+	// fraction instead of subpos, and step stepWhole frames plus stepFrac 2^-64ths
+	// per output frame. a ramp adds rampFrac to the step for rampLeft frames then
+	// lands on the target exactly. padded counts the silence pulled in past the end
+	// of the input at eof, output stops once the frame it's for is silence too.
+	int32_t vary;
+	uint64_t frac;
+	uint32_t stepWhole;
+	uint64_t stepFrac;
+	uint32_t targetWhole;
+	uint64_t targetFrac;
+	int64_t rampFrac;
+	int64_t rampLeft;
+	int32_t padded;
+	// overlap-save stages: planar input and output blocks plus scratch
+	float *fftIn;
+	float *fftOut;
+	float *fftX;
+	float *fftY;
+	float *fftSeg;
+	float *fftWork;
+	int32_t fftHave;
+	int32_t fftOutPos;
+	int32_t fftOutLen;
+	int32_t fftSkip;
+	// packed input and output go through these a block at a time
+	float *packIn;
+	float *packOut;
+} sincState;
+
+static int64_t sinc_state_seek(sincState *st, int64_t outPos);
+
+static void sinc_state_init(sincState *st, const swsContext *ctx, const sincStage *stage, int32_t numChannels,
+						int32_t bits, int32_t outBits, float gain) {
+	memset(st, 0, sizeof(sincState));
+	st->dsp = ctx->dsp;
+	st->stage = stage;
+	st->numChannels = numChannels;
+	st->bits = bits;
+	st->outBits = outBits;
+	st->gain = gain;
+
+	// above two channels the history is kept planar, one buffer per channel, so each
+	// channel is a plain mono dot product instead of a loop strided by the channel
+	// count. c0 to c1 is the range of channels this state works on, threads can
+	// split a planar sound between them by channel.
+	st->planar = numChannels > 2;
+	st->c0 = 0;
+	st->c1 = numChannels;
+
+	// the history is a linear buffer of HISTORY_WINDOWS windows, the current window
+	// is always the windowSize frames before pos. when pos hits the end the last
+	// window is moved back to the start, so the kernel never wraps.
+	st->dither = sinc_calloc(numChannels, sizeof(float));
+	if (stage->fft != NULL) {
+		int32_t bins = stage->fftSize / 2 + 1;
+
+		st->fftIn = sinc_malloc(sizeof(float) * stage->fftSize * stage->inStep * numChannels);
+		st->fftOut = sinc_malloc(sizeof(float) * stage->fftBlock * stage->outStep * numChannels);
+		st->fftX = sinc_malloc(sizeof(float) * bins * 2 * stage->inStep);
+		st->fftY = sinc_malloc(sizeof(float) * bins * 2);
+		st->fftSeg = sinc_malloc(sizeof(float) * stage->fftSize);
+		st->fftWork = sinc_malloc(sizeof(float) * swsFftWorkSize(stage->fftSize));
+		if (st->fftIn == NULL || st->fftOut == NULL || st->fftX == NULL || st->fftY == NULL || st->fftSeg == NULL
+			|| st->fftWork == NULL || st->dither == NULL) wavFatal("sinc_state_init() allocation failure");
+	} else if (stage->bankFixed != NULL && (bits == 8 || bits == 16)) {
+		// 8 and 16 bit input fits the history as is, 8 bit centred on 0
+		st->yFixed = sinc_calloc(stage->windowSize * HISTORY_WINDOWS * numChannels, sizeof(int16_t));
+		if (st->yFixed == NULL || st->dither == NULL) wavFatal("sinc_state_init() allocation failure");
+	} else {
+		st->y = sinc_calloc(stage->windowSize * HISTORY_WINDOWS * numChannels, sizeof(float));
+		st->h = sinc_malloc(stage->windowSize * sizeof(float));
+		if (st->y == NULL || st->h == NULL || st->dither == NULL) wavFatal("sinc_state_init() allocation failure");
+	}
+	if (bits & WAV_PACKED) {
+		st->packIn = sinc_malloc(sizeof(float) * SINC_PACK_FRAMES * numChannels);
+		if (st->packIn == NULL) wavFatal("sinc_state_init() allocation failure");
+	}
+	if (outBits & WAV_PACKED) {
+		st->packOut = sinc_malloc(sizeof(float) * SINC_PACK_FRAMES * numChannels);
+		if (st->packOut == NULL) wavFatal("sinc_state_init() allocation failure");
+	}
+	sinc_state_seek(st, 0);
+}
 
-		for (c = 0; c < numChannels; c++)
-			samples[c] = 0.0f;
+static void sinc_state_free(sincState *st) {
+	free(st->y);
+	free(st->yFixed);
+	free(st->h);
+	free(st->dither);
+	free(st->fftIn);
+	free(st->fftOut);
+	free(st->fftX);
+	free(st->fftY);
+	free(st->fftSeg);
+	free(st->fftWork);
+	free(st->packIn);
+	free(st->packOut);
+}
 
-		interp = offset * (RESAMPLE_LUT_STEP - 1);
-		index = interp;
-		interp -= index;
-		lutPart = dynamicLut + index * windowSize;
+// one output frame on at a variable ratio, returns the input frames it steps over
+static inline int32_t sinc_vary_step(sincState *st) {
+	uint64_t frac = st->frac + st->stepFrac;
+	int32_t frames = st->stepWhole + (frac < st->frac);
+
+	st->frac = frac;
+	if (st->rampLeft > 0 && --st->rampLeft == 0) {
+		st->stepWhole = st->targetWhole;
+		st->stepFrac = st->targetFrac;
+	} else if (st->rampLeft > 0) {
+		frac = st->stepFrac + (uint64_t)st->rampFrac;
+		if (st->rampFrac >= 0 && frac < st->stepFrac)
+			st->stepWhole++;
+		else if (st->rampFrac < 0 && frac > st->stepFrac)
+			st->stepWhole--;
+		st->stepFrac = frac;
+	}
+	return frames;
+}
 
-		for (i = next; i < windowSize; i++, lutPart++)
-		{
-			float scale = lutPart->value + lutPart->delta * interp;
+// step whole input frames plus frac 2^-64ths per output frame from rampFrames
+// output frames on, moved there in even steps. a change too sudden for the ramp's
+// per frame step to hold is made at once.
+static void sinc_vary_set(sincState *st, uint32_t whole, uint64_t frac, int32_t rampFrames) {
+	double step = ((double)whole - st->stepWhole) * 0x1p64 + ((double)frac - (double)st->stepFrac);
+
+	st->targetWhole = whole;
+	st->targetFrac = frac;
+	st->rampLeft = 0;
+	if (rampFrames > 1 && fabs(step / rampFrames) < 0x1p62) {
+		st->rampFrac = step / rampFrames;
+		st->rampLeft = rampFrames;
+	} else {
+		st->stepWhole = whole;
+		st->stepFrac = frac;
+	}
+}
 
-			for (c = 0; c < numChannels; c++)
-				samples[c] += y[i * numChannels + c] * scale;
-		}
+#define CUINT8TOF(x)	((float)x - 128.0f)
 
-		for (i = 0; i < next; i++, lutPart++)
-		{
-			float scale = lutPart->value + lutPart->delta * interp;
+// bits is 8, 16 or 32 (float), the callers pass it as a constant so each format
+// compiles as its own path, WAV_S24 and WAV_S32 are converted around the kernel a
+// block at a time by sinc_resample(). output bits can also be SINC_RAW, the unclipped float
+// sum, which lets threads filter in parallel and leave the sequential dither to
+// one quantize pass, and carries the signal between stages.
+#define SINC_RAW		0
+
+// packed samples convert to and from float exactly as wavLoadFile and wavSaveFile
+// do, so a packed sound resamples to the same samples as its float layout. full
+// scale is clamped, the float path wraps it.
+static inline float sinc_unpack(const void *p, int64_t i, int32_t bits) {
+	const uint8_t *b = (const uint8_t*)p + i * 3;
+	int32_t v;
+
+	if (bits == WAV_S24)
+		return (int32_t)((uint32_t)b[0] << 8 | (uint32_t)b[1] << 16 | (uint32_t)b[2] << 24) * (1.0f / 2147483648.0f);
+	// a view into a file is only as aligned as its data chunk
+	memcpy(&v, (const uint8_t*)p + i * 4, 4);
+	return v * (1.0f / 2147483648.0f);
+}
 
-			for (c = 0; c < numChannels; c++)
-				samples[c] += y[i * numChannels + c] * scale;
-		}
+static inline void sinc_pack(void *p, int64_t i, float v, int32_t bits) {
+	int32_t r;
 
-		for (c = 0; c < numChannels; c++)
-		{
-			float r = roundf(samples[c] + dither[c]);
-			dither[c] += samples[c] - r;
+	if (v >= 1.0f)
+		r = INT32_MAX;
+	else if (v <= -1.0f)
+		r = INT32_MIN;
+	else
+		r = (int32_t)(v * 2147483648.0f);
+	if (bits == WAV_S24) {
+		uint8_t *b = (uint8_t*)p + i * 3;
+
+		b[0] = r >> 8;
+		b[1] = r >> 16;
+		b[2] = r >> 24;
+	} else
+		((int32_t*)p)[i] = r;
+}
 
-			if (r > 32767)
-				*sampleOut++ = 32767;
-			else if (r < -32768)
-				*sampleOut++ = -32768;
-			else
-				*sampleOut++ = r;
-		}
+static inline float sinc_sample_in(const void *p, int64_t i, int32_t bits) {
+	if (bits == 8)
+		return CUINT8TOF(((const uint8_t*)p)[i]);
+	else if (bits == 16)
+		return ((const int16_t*)p)[i];
+	else if (bits & WAV_PACKED)
+		return sinc_unpack(p, i, bits);
+	return ((const float*)p)[i];
+}
 
-		subpos += inFreq;
-		while (subpos >= outFreq)
-		{
-			subpos -= outFreq;
+static inline int16_t sinc_sample_in_fixed(const void *p, int64_t i, int32_t bits) {
+	if (bits == 8)
+		return (int16_t)((const uint8_t*)p)[i] - 128;
+	return ((const int16_t*)p)[i];
+}
 
-			for (c = 0; c < numChannels; c++)
-				y[next * numChannels + c] = (sampleIn < wavInEnd) ? *sampleIn++ : 0;
+static inline void sinc_sample_out(void *p, int64_t i, float v, float *dither, int32_t bits) {
+	float r;
 
-			next = (next + 1) % windowSize;
-		}
+	if (bits == SINC_RAW) {
+		((float*)p)[i] = v;
+		return;
+	} else if (bits == 32) {
+		if (v > 1.0f)
+			((float*)p)[i] = 1.0f;
+		else if (v < -1.0f)
+			((float*)p)[i] = -1.0f;
+		else
+			((float*)p)[i] = v;
+		return;
+	} else if (bits & WAV_PACKED) {
+		sinc_pack(p, i, v, bits);
+		return;
 	}
-}
 
-static inline void sinc_resampleF_internal(float *wavOut, int32_t sizeOut, int32_t outFreq, 
-						const float *wavIn, int32_t sizeIn, int32_t inFreq, int32_t cutoffFreq2,
-						int32_t numChannels, int32_t windowSize, double beta) {
-	float y[windowSize * numChannels];
-	const float *sampleIn, *wavInEnd = wavIn + (sizeIn / 4);
-	float *sampleOut, *wavOutEnd = wavOut + (sizeOut / 4);
-	float outPeriod;
-	int subpos = 0;
-	int gcd = calc_gcd(inFreq, outFreq);
-	int i, c, next;
+	r = roundf(v + *dither);
+	*dither += v - r;
+
+	if (bits == 8) {
+		if (r > 127)
+			((uint8_t*)p)[i] = 255;
+		else if (r < -128)
+			((uint8_t*)p)[i] = 0;
+		else
+			((uint8_t*)p)[i] = (uint8_t)(r + 128);
+	} else {
+		if (r > 32767)
+			((int16_t*)p)[i] = 32767;
+		else if (r < -32768)
+			((int16_t*)p)[i] = -32768;
+		else
+			((int16_t*)p)[i] = r;
+	}
+}
 
-	sinc_resample_createLut(inFreq, cutoffFreq2, windowSize, beta);
+static inline int32_t sinc_frame_bytes(int32_t bits, int32_t numChannels) {
+	// 24 and 32 bit are float internally, unless packed
+	if (bits & WAV_PACKED)
+		return (WAV_BITS(bits) >> 3) * numChannels;
+	return (bits == 24 ? 4 : bits >> 3) * numChannels;
+}
 
-	inFreq /= gcd;
-	outFreq /= gcd;
-	outPeriod = 1.0f / outFreq;
+// filter one block of the input history into the output block, channel by channel
+static void sinc_fft_block(sincState *st) {
+	const sincStage *stage = st->stage;
+	const int32_t inStep = stage->inStep, outStep = stage->outStep;
+	const int32_t size = stage->fftSize, bins = size / 2 + 1;
+	const int32_t block = stage->fftBlock, taps = stage->fftTaps;
+	float *yr = st->fftY, *yi = st->fftY + bins;
+	int32_t c, r, slot, k;
 
-	for (i = 0; i < windowSize / 2 - 1; i++)
+	for (c = st->c0; c < st->c1; c++)
 	{
-		for (c = 0; c < numChannels; c++)
-			y[i * numChannels + c] = 0;
+		const float *x = st->fftIn + c * size * inStep;
+		float *out = st->fftOut + c * block * outStep;
+
+		for (r = 0; r < inStep; r++)
+		{
+			for (k = 0; k < size; k++)
+				st->fftSeg[k] = x[k * inStep + r];
+			swsFftForward(stage->fft, st->fftSeg, st->fftX + r * bins * 2, st->fftX + r * bins * 2 + bins, st->fftWork);
+		}
+
+		for (slot = 0; slot < outStep; slot++)
+		{
+			memset(st->fftY, 0, sizeof(float) * bins * 2);
+			for (r = 0; r < inStep; r++)
+			{
+				const float *xr = st->fftX + r * bins * 2, *xi = xr + bins;
+
+				st->dsp->cmac(yr, yi, xr, xi, stage->fftRe + (slot * inStep + r) * bins, stage->fftIm + (slot * inStep + r) * bins, bins);
+			}
+			swsFftInverse(stage->fft, yr, yi, st->fftSeg, st->fftWork);
+			for (k = 0; k < block; k++)
+				out[k * outStep + slot] = st->fftSeg[k + taps - 1];
+		}
 	}
 
-	sampleIn = wavIn;
-	for (; i < windowSize; i++)
+	st->fftOutLen = block * outStep;
+	st->fftOutPos = st->fftSkip;
+	st->fftSkip = 0;
+}
+
+// sinc_resample for overlap-save stages, the transforms dwarf the sample
+// conversions so there is only the one generic path
+static int64_t sinc_fft_resample(sincState *st, void *wavOut, int64_t outFrames,
+						const void *wavIn, int64_t inFrames, int64_t *inUsed, int32_t eof) {
+	const sincStage *stage = st->stage;
+	const int32_t numChannels = st->numChannels;
+	const int32_t span = stage->fftSize * stage->inStep;
+	const int32_t advance = stage->fftBlock * stage->inStep;
+	const int32_t blockOut = stage->fftBlock * stage->outStep;
+	int64_t frameIn = 0, frameOut = 0, i, n, avail;
+	int32_t c;
+
+	while (frameOut < outFrames)
 	{
-		for (c = 0; c < numChannels; c++)
-			y[i * numChannels + c] = (sampleIn < wavInEnd) ? *sampleIn++ : 0;
+		if (st->fftOutPos < st->fftOutLen) {
+			n = st->fftOutLen - st->fftOutPos;
+			if (n > outFrames - frameOut) n = outFrames - frameOut;
+			for (c = st->c0; c < st->c1; c++)
+			{
+				const float *o = st->fftOut + c * blockOut + st->fftOutPos;
+
+				for (i = 0; i < n; i++)
+					sinc_sample_out(wavOut, (frameOut + i) * numChannels + c, o[i] * st->gain, &st->dither[c], st->outBits);
+			}
+			st->fftOutPos += n;
+			frameOut += n;
+			continue;
+		}
+
+		// fill the history up to a whole block, silence past eof
+		while (st->fftHave < span)
+		{
+			n = span - st->fftHave;
+			avail = inFrames - frameIn;
+			if (avail <= 0 && !eof)
+				goto starved;
+			if (avail > 0 && n > avail) n = avail;
+
+			for (c = st->c0; c < st->c1; c++)
+			{
+				float *x = st->fftIn + c * span + st->fftHave;
+
+				if (avail > 0) {
+					for (i = 0; i < n; i++)
+						x[i] = sinc_sample_in(wavIn, (frameIn + i) * numChannels + c, st->bits);
+				} else
+					memset(x, 0, sizeof(float) * n);
+			}
+			if (avail > 0)
+				frameIn += n;
+			st->fftHave += n;
+		}
+
+		sinc_fft_block(st);
+
+		// the next block starts advance frames later
+		for (c = st->c0; c < st->c1; c++)
+			memmove(st->fftIn + c * span, st->fftIn + c * span + advance, sizeof(float) * (span - advance));
+		st->fftHave -= advance;
 	}
 
-	sampleOut = wavOut;
-	next = 0;
-	while (sampleOut < wavOutEnd)
+starved:
+	*inUsed = frameIn;
+	return frameOut;
+}
+
+// sinc_state_seek for overlap-save stages, back to the start of the block that
+// holds outPos
+static int64_t sinc_fft_seek(sincState *st, int64_t outPos) {
+	const sincStage *stage = st->stage;
+	const int32_t span = stage->fftSize * stage->inStep;
+	const int64_t blockOut = (int64_t)stage->fftBlock * stage->outStep;
+	int64_t b = outPos / blockOut;
+	int64_t first = b * stage->fftBlock * stage->inStep - stage->lead;
+	int32_t zeros = (first < 0) ? -first : 0;
+	int32_t c;
+
+	for (c = st->c0; c < st->c1; c++)
+		memset(st->fftIn + c * span, 0, zeros * sizeof(float));
+
+	st->fftHave = zeros;
+	st->fftOutPos = st->fftOutLen = 0;
+	st->fftSkip = outPos - b * blockOut;
+	return first + zeros;
+}
+
+// run the resampler until either outFrames are written or the input runs dry,
+// when eof is set missing input is treated as silence. returns frames written,
+// *inUsed gets the input frames consumed. fixed runs the integer history and
+// bank, the sums are scaled back to float before the same output rounding.
+static inline int64_t sinc_resample_internal(sincState *st, void *wavOut, int64_t outFrames,
+						const void *wavIn, int64_t inFrames, int64_t *inUsed, int32_t eof,
+						int32_t numChannels, int32_t planar, int32_t fixed, int32_t bits, int32_t outBits) {
+	const sincStage *stage = st->stage;
+	const swsDsp *dsp = st->dsp;
+	const int32_t windowSize = stage->windowSize;
+	const int32_t span = windowSize * HISTORY_WINDOWS;
+	const int32_t inFreq = stage->inStep;
+	const int32_t outFreq = stage->outStep;
+	const float outPeriod = stage->outPeriod;
+	const int32_t vary = st->vary;
+	const int32_t c0 = planar ? st->c0 : 0;
+	const int32_t c1 = planar ? st->c1 : numChannels;
+	float *y = st->y;
+	int16_t *yFixed = st->yFixed;
+	float *dither = st->dither;
+	const float gain = st->gain;
+	int32_t subpos = st->subpos;
+	int32_t pos = st->pos;
+	int32_t pending = st->pending;
+	int64_t frameIn = 0, frameOut = 0;
+	int c;
+
+	while (frameOut < outFrames)
 	{
 		float samples[numChannels];
-		float offset = 1.0f - subpos * outPeriod;
+		const float *h;
 		float interp;
-		lutEntry_t *lutPart;
 		int index;
+		int reverse;
 
-		for (c = 0; c < numChannels; c++)
-			samples[c] = 0.0f;
-
-		interp = offset * (RESAMPLE_LUT_STEP - 1);
-		index = interp;
-		interp -= index;
-		lutPart = dynamicLut + index * windowSize;
-
-		for (i = next; i < windowSize; i++, lutPart++)
+		// pull in the input frames the last output frame stepped over
+		while (pending > 0)
 		{
-			float scale = lutPart->value + lutPart->delta * interp;
+			if (frameIn >= inFrames && !eof)
+				goto starved;
+
+			if (pos == span) {
+				if (fixed && planar) {
+					for (c = c0; c < c1; c++)
+						memmove(yFixed + c * span, yFixed + c * span + pos - windowSize + 1, (windowSize - 1) * sizeof(int16_t));
+				} else if (fixed)
+					memmove(yFixed, yFixed + (pos - windowSize + 1) * numChannels, (windowSize - 1) * numChannels * sizeof(int16_t));
+				else if (planar) {
+					for (c = c0; c < c1; c++)
+						memmove(y + c * span, y + c * span + pos - windowSize + 1, (windowSize - 1) * sizeof(float));
+				} else
+					memmove(y, y + (pos - windowSize + 1) * numChannels, (windowSize - 1) * numChannels * sizeof(float));
+				pos = windowSize - 1;
+			}
 
-			for (c = 0; c < numChannels; c++)
-				samples[c] += y[i * numChannels + c] * scale;
+			for (c = c0; c < c1; c++)
+			{
+				float v;
+
+				if (fixed) {
+					int16_t f = (frameIn < inFrames) ? sinc_sample_in_fixed(wavIn, frameIn * numChannels + c, bits) : 0;
+
+					if (planar)
+						yFixed[c * span + pos] = f;
+					else
+						yFixed[pos * numChannels + c] = f;
+					continue;
+				}
+				v = (frameIn < inFrames) ? sinc_sample_in(wavIn, frameIn * numChannels + c, bits) : 0;
+				if (planar)
+					y[c * span + pos] = v;
+				else
+					y[pos * numChannels + c] = v;
+			}
+			if (frameIn < inFrames)
+				frameIn++;
+			else
+				st->padded++;
+
+			pos++;
+			pending--;
 		}
+		if (vary && st->padded >= windowSize - stage->lead)
+			break;
 
-		for (i = 0; i < next; i++, lutPart++)
-		{
-			float scale = lutPart->value + lutPart->delta * interp;
+		// exact row from the polyphase bank, or interpolated between lut rows
+		if (stage->bank != NULL)
+			h = stage->bank + subpos * windowSize;
+		else {
+			if (vary) {
+				// in double, float can't hold the fraction's precision
+				double at = (1.0 - st->frac * 0x1p-64) * (RESAMPLE_LUT_STEP - 1);
+
+				index = at;
+				interp = at - index;
+			} else {
+				interp = (1.0f - subpos * outPeriod) * (RESAMPLE_LUT_STEP - 1);
+				index = interp;
+				interp -= index;
+			}
+			if (index > RESAMPLE_LUT_STEP - 2) {
+				index = RESAMPLE_LUT_STEP - 2;
+				interp = 1.0f;
+			}
+			// the second half is the first mirrored, the step from row i to i + 1 is
+			// the step from row 126 - i to 127 - i back to front
+			reverse = index >= RESAMPLE_LUT_HALF && !stage->minPhase;
+			if (reverse) {
+				index = RESAMPLE_LUT_STEP - 2 - index;
+				interp = 1.0f - interp;
+			}
+			if (stage->lut16Value != NULL)
+				dsp->lerp16(st->h, stage->lut16Value + index * windowSize, stage->lut16Delta + index * windowSize,
+							interp, windowSize, reverse);
+			else
+				dsp->lerp(st->h, stage->lutValue + index * windowSize, stage->lutDelta + index * windowSize,
+							interp, windowSize, reverse);
+			h = st->h;
+		}
 
-			for (c = 0; c < numChannels; c++)
-				samples[c] += y[i * numChannels + c] * scale;
+		if (fixed) {
+			const int16_t *hFixed = stage->bankFixed + subpos * windowSize;
+			int32_t sums[2];
+
+			if (planar) {
+				for (c = c0; c < c1; c++)
+					samples[c] = dsp->dot1i(yFixed + c * span + pos - windowSize, hFixed, windowSize) * stage->fixedScale;
+			} else if (numChannels == 1)
+				samples[0] = dsp->dot1i(yFixed + pos - windowSize, hFixed, windowSize) * stage->fixedScale;
+			else {
+				dsp->dot2i(yFixed + (pos - windowSize) * 2, hFixed, windowSize, sums);
+				samples[0] = sums[0] * stage->fixedScale;
+				samples[1] = sums[1] * stage->fixedScale;
+			}
+		} else if (planar) {
+			for (c = c0; c < c1; c++)
+				samples[c] = dsp->dot1(y + c * span + pos - windowSize, h, windowSize);
+		} else if (numChannels == 1)
+			samples[0] = dsp->dot1(y + pos - windowSize, h, windowSize);
+		else {
+			samples[0] = samples[1] = 0.0f;
+			dsp->dot2(y + (pos - windowSize) * 2, h, windowSize, samples);
 		}
 
-		for (c = 0; c < numChannels; c++)
-		{
-			float r = samples[c];
+		for (c = c0; c < c1; c++)
+			sinc_sample_out(wavOut, frameOut * numChannels + c, samples[c] * gain, &dither[c], outBits);
+		frameOut++;
 
-			if (r > 1.0f)
-				*sampleOut++ = 1.0f;
-			else if (r < -1.0f)
-				*sampleOut++ = -1.0f;
-			else
-				*sampleOut++ = r;
+		if (vary) {
+			pending += sinc_vary_step(st);
+			continue;
 		}
-
 		subpos += inFreq;
 		while (subpos >= outFreq)
 		{
 			subpos -= outFreq;
+			pending++;
+		}
+	}
 
-			for (c = 0; c < numChannels; c++)
-				y[next * numChannels + c] = (sampleIn < wavInEnd) ? *sampleIn++ : 0;
+starved:
+	st->subpos = subpos;
+	st->pos = pos;
+	st->pending = pending;
+	*inUsed = frameIn;
+	return frameOut;
+}
 
-			next = (next + 1) % windowSize;
-		}
+#define SINC_RESAMPLE_FIXED(bits, outBits) \
+	if (st->numChannels == 1) \
+		return sinc_resample_internal(st, wavOut, outFrames, wavIn, inFrames, inUsed, eof, 1, 0, 1, bits, outBits); \
+	else if (st->numChannels == 2) \
+		return sinc_resample_internal(st, wavOut, outFrames, wavIn, inFrames, inUsed, eof, 2, 0, 1, bits, outBits); \
+	else \
+		return sinc_resample_internal(st, wavOut, outFrames, wavIn, inFrames, inUsed, eof, st->numChannels, 1, 1, bits, outBits);
+
+#define SINC_RESAMPLE_CHANNELS(bits, outBits) \
+	if (((bits) == 8 || (bits) == 16) && st->yFixed != NULL) { \
+		SINC_RESAMPLE_FIXED(bits, outBits) \
+	} else if (st->numChannels == 1) \
+		return sinc_resample_internal(st, wavOut, outFrames, wavIn, inFrames, inUsed, eof, 1, 0, 0, bits, outBits); \
+	else if (st->numChannels == 2) \
+		return sinc_resample_internal(st, wavOut, outFrames, wavIn, inFrames, inUsed, eof, 2, 0, 0, bits, outBits); \
+	else \
+		return sinc_resample_internal(st, wavOut, outFrames, wavIn, inFrames, inUsed, eof, st->numChannels, 1, 0, bits, outBits);
+
+#define SINC_RESAMPLE_OUT(bits) \
+	switch (st->outBits) { \
+		case 8: SINC_RESAMPLE_CHANNELS(bits, 8) \
+		case 16: SINC_RESAMPLE_CHANNELS(bits, 16) \
+		case 32: SINC_RESAMPLE_CHANNELS(bits, 32) \
+		default: SINC_RESAMPLE_CHANNELS(bits, SINC_RAW) \
+	}
+
+static int64_t sinc_resample_block(sincState *st, void *wavOut, int64_t outFrames,
+						const void *wavIn, int64_t inFrames, int64_t *inUsed, int32_t eof) {
+	if (st->stage->fft != NULL)
+		return sinc_fft_resample(st, wavOut, outFrames, wavIn, inFrames, inUsed, eof);
+
+	// should compile as different paths
+	// number of channels and sample formats need to be compiled as separate paths
+	// to ensure good vectorization by the compiler
+	switch (st->bits) {
+		case 8:
+			SINC_RESAMPLE_OUT(8)
+		case 16:
+			SINC_RESAMPLE_OUT(16)
+		default:
+			SINC_RESAMPLE_OUT(32)
 	}
 }
 
-void sinc_resample8(uint8_t *wavOut, int32_t sizeOut, int32_t outFreq, const uint8_t *wavIn,
-						int32_t sizeIn, int32_t inFreq, int32_t numChannels) {
-	double sidelobeHeight = SIDELOBE_HEIGHT;
-	double transitionWidth;
-	double beta = 0.0;
-	int32_t cutoffFreq2;
-	int32_t windowSize;
+// packed output from the raw sums of one block, only the state's own channels
+static void sinc_pack_block(sincState *st, void *wavOut, int64_t frame, int64_t frames, int32_t bits) {
+	const int32_t numChannels = st->numChannels;
+	int64_t i;
+	int32_t c;
 
-	// Just copy if no resampling necessary
-	if (outFreq == inFreq)
-	{
-		memcpy(wavOut, wavIn, (sizeOut < sizeIn) ? sizeOut : sizeIn);
+	if (st->c0 == 0 && st->c1 == numChannels) {
+		st->dsp->store((uint8_t*)wavOut + frame * sinc_frame_bytes(bits, numChannels), st->packOut, frames * numChannels, bits);
 		return;
 	}
+	for (i = 0; i < frames; i++)
+	{
+		for (c = st->c0; c < st->c1; c++)
+			sinc_pack(wavOut, (frame + i) * numChannels + c, st->packOut[i * numChannels + c], bits);
+	}
+}
 
-	transitionWidth = (outFreq > inFreq) ? UP_TRANSITION_WIDTH : DOWN_TRANSITION_WIDTH;
+// packed input is unpacked a block at a time by the dsp kernels and filtered as
+// float, packed output is filtered into a block of raw sums and packed after, so
+// neither is converted a sample at a time inside the filter loop
+static int64_t sinc_resample(sincState *st, void *wavOut, int64_t outFrames,
+						const void *wavIn, int64_t inFrames, int64_t *inUsed, int32_t eof) {
+	const int32_t bits = st->bits, outBits = st->outBits, numChannels = st->numChannels;
+	const int32_t inBytes = sinc_frame_bytes(bits, numChannels);
+	const int32_t outBytes = (outBits == SINC_RAW) ? numChannels * sizeof(float) : sinc_frame_bytes(outBits, numChannels);
+	int64_t frameIn = 0, frameOut = 0;
+
+	if (!((bits | outBits) & WAV_PACKED))
+		return sinc_resample_block(st, wavOut, outFrames, wavIn, inFrames, inUsed, eof);
+
+	st->bits = (bits & WAV_PACKED) ? 32 : bits;
+	st->outBits = (outBits & WAV_PACKED) ? SINC_RAW : outBits;
+	while (frameOut < outFrames)
+	{
+		const void *in = (const uint8_t*)wavIn + frameIn * inBytes;
+		void *out = (uint8_t*)wavOut + frameOut * outBytes;
+		int64_t n = inFrames - frameIn, m = outFrames - frameOut, used, got;
+
+		if (bits & WAV_PACKED) {
+			double t = sinc_stats_clock();
+
+			if (n > SINC_PACK_FRAMES) n = SINC_PACK_FRAMES;
+			st->dsp->load(st->packIn, in, n * numChannels, bits);
+			in = st->packIn;
+			if (sinc_stats)
+				sinc_stats->decodeTime += swsStatsClock() - t;
+		}
+		if (outBits & WAV_PACKED) {
+			if (m > SINC_PACK_FRAMES) m = SINC_PACK_FRAMES;
+			out = st->packOut;
+		}
+		got = sinc_resample_block(st, out, m, in, n, &used, eof && frameIn + n == inFrames);
+		if (outBits & WAV_PACKED) {
+			double t = sinc_stats_clock();
 
-	// cutoff freq is ideally half transition width away from output freq
-	cutoffFreq2 = outFreq - transitionWidth * inFreq * 0.5;
+			sinc_pack_block(st, wavOut, frameOut, got, outBits);
+			if (sinc_stats)
+				sinc_stats->convertTime += swsStatsClock() - t;
+		}
+		frameIn += used;
+		frameOut += got;
+		// starved with all of the input used
+		if (got < m && frameIn == inFrames)
+			break;
+	}
+	st->bits = bits;
+	st->outBits = outBits;
+	*inUsed = frameIn;
+	return frameOut;
+}
 
-	// FIXME: Figure out why there are bad effects with cutoffFreq2 > inFreq
-	if (cutoffFreq2 > inFreq)
-		cutoffFreq2 = inFreq;
+// set the state up to make output frame outPos next. the part of the window
+// before the input starts is silence, the rest is left pending so the kernel pulls
+// it in. returns the first input frame the state needs.
+static int64_t sinc_state_seek(sincState *st, int64_t outPos) {
+	const sincStage *stage = st->stage;
+	int32_t windowSize = stage->windowSize;
+	int32_t span = windowSize * HISTORY_WINDOWS;
+	int64_t first = outPos * stage->inStep / stage->outStep - stage->lead;
+	int32_t zeros = (first < 0) ? -first : 0;
+	int32_t c;
+
+	if (stage->fft != NULL)
+		return sinc_fft_seek(st, outPos);
+
+	if (st->yFixed != NULL && st->planar) {
+		for (c = st->c0; c < st->c1; c++)
+			memset(st->yFixed + c * span, 0, zeros * sizeof(int16_t));
+	} else if (st->yFixed != NULL)
+		memset(st->yFixed, 0, zeros * st->numChannels * sizeof(int16_t));
+	else if (st->planar) {
+		for (c = st->c0; c < st->c1; c++)
+			memset(st->y + c * span, 0, zeros * sizeof(float));
+	} else
+		memset(st->y, 0, zeros * st->numChannels * sizeof(float));
+
+	st->subpos = (outPos * stage->inStep) % stage->outStep;
+	st->frac = 0;
+	st->padded = 0;
+	st->pos = zeros;
+	st->pending = windowSize - zeros;
+	return first + zeros;
+}
 
-	// https://www.mathworks.com/help/signal/ug/kaiser-window.html
-	if (sidelobeHeight > 50)
-		beta = 0.1102 * (sidelobeHeight - 8.7);
-	else if (sidelobeHeight >= 21)
-		beta = 0.5842 * pow(sidelobeHeight - 21.0, 0.4) + 0.07886 * (sidelobeHeight - 21.0);
+static inline int64_t sinc_out_frames(const swsContext *ctx, int64_t inFrames) {
+	return inFrames * (int64_t)ctx->outStep / (int64_t)ctx->inStep;
+}
 
-	windowSize = (sidelobeHeight - 8.0) / (2.285 * transitionWidth * M_PI) + 1;
+// the kernel works in the input's own sample range, 8 bit as -128..127, 16 bit as
+// -32768..32767 and the rest as -1..1, the output format wants its own
+static inline float sinc_range(int32_t bits) {
+	return (bits == 8) ? 128.0f : (bits == 16) ? 32768.0f : 1.0f;
+}
 
-	if (windowSize > MAX_SINC_WINDOW_SIZE)
-		windowSize = MAX_SINC_WINDOW_SIZE;
+static inline float sinc_gain(int32_t bits, int32_t outBits) {
+	return sinc_range(outBits) / sinc_range(bits);
+}
 
-	// should compile as different paths
-	// number of channels need to be compiled as separate paths to ensure good
-	// vectorization by the compiler
-	if (numChannels == 1)
-		sinc_resample8_internal(wavOut, sizeOut, outFreq, wavIn, sizeIn, inFreq, cutoffFreq2, 1, windowSize, beta);
-	else if (numChannels == 2)
-		sinc_resample8_internal(wavOut, sizeOut, outFreq, wavIn, sizeIn, inFreq, cutoffFreq2, 2, windowSize, beta);
-	else
-		sinc_resample8_internal(wavOut, sizeOut, outFreq, wavIn, sizeIn, inFreq, cutoffFreq2, numChannels, windowSize, beta);
+static inline int32_t sinc_valid_bits(int32_t bits) {
+	return bits == 8 || bits == 16 || bits == 24 || bits == 32 || bits == WAV_S24 || bits == WAV_S32;
 }
 
-void sinc_resample16(int16_t *wavOut, int32_t sizeOut, int32_t outFreq, const int16_t *wavIn,
-						int32_t sizeIn, int32_t inFreq, int32_t numChannels) {
-	double sidelobeHeight = SIDELOBE_HEIGHT;
-	double transitionWidth;
-	double beta = 0.0;
-	int32_t cutoffFreq2;
-	int32_t windowSize;
+// no resampling, just the format change, rounded the same way the kernel does
+static void sinc_convert(void *wavOut, const void *wavIn, int64_t frames, float *dither, int32_t numChannels,
+						int32_t bits, int32_t outBits) {
+	float gain = sinc_gain(bits, outBits);
+	int64_t i;
+	int32_t c;
+
+	// 24 bit is float internally
+	if (bits == 24) bits = 32;
+	if (outBits == 24) outBits = 32;
+	for (i = 0; i < frames; i++)
+	{
+		for (c = 0; c < numChannels; c++)
+			sinc_sample_out(wavOut, i * numChannels + c, sinc_sample_in(wavIn, i * numChannels + c, bits) * gain,
+							&dither[c], outBits);
+	}
+}
 
-	// Just copy if no resampling necessary
-	if (outFreq == inFreq)
+static inline void sinc_quantize_internal(void *wavOut, const float *raw, int64_t frames, float *dither,
+						int32_t numChannels, int32_t bits) {
+	int64_t i;
+	int32_t c;
+
+	for (i = 0; i < frames; i++)
 	{
-		memcpy(wavOut, wavIn, (sizeOut < sizeIn) ? sizeOut : sizeIn);
-		return;
+		for (c = 0; c < numChannels; c++)
+			sinc_sample_out(wavOut, i * numChannels + c, raw[i * numChannels + c], &dither[c], bits);
 	}
+}
 
-	transitionWidth = (outFreq > inFreq) ? UP_TRANSITION_WIDTH : DOWN_TRANSITION_WIDTH;
+static void sinc_quantize(void *wavOut, const float *raw, int64_t frames, float *dither, int32_t numChannels, int32_t bits) {
+	double t = sinc_stats_clock();
 
-	// cutoff freq is ideally half transition width away from output freq
-	cutoffFreq2 = outFreq - transitionWidth * inFreq * 0.5;
+	if (bits == 8)
+		sinc_quantize_internal(wavOut, raw, frames, dither, numChannels, 8);
+	else
+		sinc_quantize_internal(wavOut, raw, frames, dither, numChannels, 16);
+	if (sinc_stats)
+		sinc_stats->convertTime += swsStatsClock() - t;
+}
 
-	// FIXME: Figure out why there are bad effects with cutoffFreq2 > inFreq
-	if (cutoffFreq2 > inFreq)
-		cutoffFreq2 = inFreq;
+// ******************************************************************************
+// stage chains. one state per stage, with a small float fifo between each pair.
+// the last stage pulls from its fifo and when that runs dry the stage before it
+// is run to refill it, back to the first stage reading the caller's input. every
+// stage only sees eof at the input, the ones after it always get more frames by
+// running the chain further. a one stage chain is the plain state.
+
+typedef struct _sincChain {
+	sincState st[MAX_STAGES];
+	float *fifo[MAX_STAGES - 1];
+	int64_t fifoPos[MAX_STAGES - 1];
+	int64_t fifoLen[MAX_STAGES - 1];
+	int32_t numStages;
+	int32_t numChannels;
+	int32_t inFrameBytes;
+	int32_t outFrameBytes;
+} sincChain;
+
+// gain goes on the last stage, see sinc_gain()
+static void sinc_chain_init(sincChain *ch, const swsContext *ctx, int32_t numChannels, int32_t bits, int32_t outBits,
+						float gain) {
+	int32_t last = ctx->numStages - 1;
+	int32_t i;
+
+	// 24 bit is float internally, packed formats are read and written as they are
+	if (bits == 24) bits = 32;
+	if (outBits == 24) outBits = 32;
+	ch->numStages = ctx->numStages;
+	ch->numChannels = numChannels;
+	ch->inFrameBytes = sinc_frame_bytes(bits, numChannels);
+	ch->outFrameBytes = sinc_frame_bytes(outBits == SINC_RAW ? 32 : outBits, numChannels);
+
+	for (i = 0; i <= last; i++)
+	{
+		sinc_state_init(&ch->st[i], ctx, &ctx->stages[i], numChannels, i == 0 ? bits : 32, i == last ? outBits : SINC_RAW,
+						i == last ? gain : 1.0f);
+		if (i < last) {
+			ch->fifo[i] = sinc_malloc(sizeof(float) * CHAIN_FIFO_FRAMES * numChannels);
+			if (ch->fifo[i] == NULL) wavFatal("sinc_chain_init() allocation failure");
+			ch->fifoPos[i] = ch->fifoLen[i] = 0;
+		}
+	}
+}
 
-	// https://www.mathworks.com/help/signal/ug/kaiser-window.html
-	if (sidelobeHeight > 50)
-		beta = 0.1102 * (sidelobeHeight - 8.7);
-	else if (sidelobeHeight >= 21)
-		beta = 0.5842 * pow(sidelobeHeight - 21.0, 0.4) + 0.07886 * (sidelobeHeight - 21.0);
+static void sinc_chain_free(sincChain *ch) {
+	int32_t i;
 
-	windowSize = (sidelobeHeight - 8.0) / (2.285 * transitionWidth * M_PI) + 1;
+	for (i = 0; i < ch->numStages; i++)
+	{
+		sinc_state_free(&ch->st[i]);
+		if (i < ch->numStages - 1)
+			free(ch->fifo[i]);
+	}
+}
 
-	if (windowSize > MAX_SINC_WINDOW_SIZE)
-		windowSize = MAX_SINC_WINDOW_SIZE;
+static void sinc_chain_channels(sincChain *ch, int32_t c0, int32_t c1) {
+	int32_t i;
 
-	// should compile as different paths
-	// number of channels need to be compiled as separate paths to ensure good
-	// vectorization by the compiler
-	if (numChannels == 1)
-		sinc_resample16_internal(wavOut, sizeOut, outFreq, wavIn, sizeIn, inFreq, cutoffFreq2, 1, windowSize, beta);
-	else if (numChannels == 2)
-		sinc_resample16_internal(wavOut, sizeOut, outFreq, wavIn, sizeIn, inFreq, cutoffFreq2, 2, windowSize, beta);
-	else
-		sinc_resample16_internal(wavOut, sizeOut, outFreq, wavIn, sizeIn, inFreq, cutoffFreq2, numChannels, windowSize, beta);
+	for (i = 0; i < ch->numStages; i++)
+	{
+		ch->st[i].c0 = c0;
+		ch->st[i].c1 = c1;
+	}
 }
 
-void sinc_resampleF(float *wavOut, int32_t sizeOut, int32_t outFreq, const float *wavIn,
-					int32_t sizeIn, int32_t inFreq, int32_t numChannels) {
-	double sidelobeHeight = SIDELOBE_HEIGHT;
-	double transitionWidth;
-	double beta = 0.0;
-	int32_t cutoffFreq2;
-	int32_t windowSize;
+// seek every stage so the last makes output frame outPos next, returns the first
+// input frame the chain needs
+static int64_t sinc_chain_seek(sincChain *ch, int64_t outPos) {
+	int32_t i;
 
-	// Just copy if no resampling necessary
-	if (outFreq == inFreq)
+	for (i = ch->numStages - 1; i >= 0; i--)
 	{
-		memcpy(wavOut, wavIn, (sizeOut < sizeIn) ? sizeOut : sizeIn);
-		return;
+		outPos = sinc_state_seek(&ch->st[i], outPos);
+		if (i > 0)
+			ch->fifoPos[i - 1] = ch->fifoLen[i - 1] = 0;
 	}
+	return outPos;
+}
 
-	transitionWidth = (outFreq > inFreq) ? UP_TRANSITION_WIDTH : DOWN_TRANSITION_WIDTH;
+// run stage i until its fifo gets new frames, refilling the stages before it as
+// they starve. returns 0 if the chain input ran dry first.
+static int32_t sinc_chain_fill(sincChain *ch, int32_t i, const uint8_t *wavIn, int64_t inFrames, int64_t *inUsed, int32_t eof) {
+	int32_t numChannels = ch->numChannels;
+	float *fifo = ch->fifo[i];
+	int64_t done, used;
+
+	// drop what the next stage already consumed
+	if (ch->fifoPos[i] > 0) {
+		memmove(fifo, fifo + ch->fifoPos[i] * numChannels, (ch->fifoLen[i] - ch->fifoPos[i]) * numChannels * sizeof(float));
+		ch->fifoLen[i] -= ch->fifoPos[i];
+		ch->fifoPos[i] = 0;
+	}
 
-	// cutoff freq is ideally half transition width away from output freq
-	cutoffFreq2 = outFreq - transitionWidth * inFreq * 0.5;
+	for (;;)
+	{
+		if (i == 0) {
+			done = sinc_resample(&ch->st[0], fifo + ch->fifoLen[0] * numChannels, CHAIN_FIFO_FRAMES - ch->fifoLen[0],
+								wavIn + *inUsed * ch->inFrameBytes, inFrames - *inUsed, &used, eof);
+			*inUsed += used;
+		} else {
+			done = sinc_resample(&ch->st[i], fifo + ch->fifoLen[i] * numChannels, CHAIN_FIFO_FRAMES - ch->fifoLen[i],
+								ch->fifo[i - 1] + ch->fifoPos[i - 1] * numChannels, ch->fifoLen[i - 1] - ch->fifoPos[i - 1], &used, 0);
+			ch->fifoPos[i - 1] += used;
+		}
+		ch->fifoLen[i] += done;
+		if (done > 0)
+			return 1;
+		if (i == 0 || !sinc_chain_fill(ch, i - 1, wavIn, inFrames, inUsed, eof))
+			return 0;
+	}
+}
 
-	// FIXME: Figure out why there are bad effects with cutoffFreq2 > inFreq
-	if (cutoffFreq2 > inFreq)
-		cutoffFreq2 = inFreq;
+// the chain version of sinc_resample
+static int64_t sinc_chain_run(sincChain *ch, void *wavOut, int64_t outFrames,
+						const void *wavIn, int64_t inFrames, int64_t *inUsed, int32_t eof) {
+	int32_t last = ch->numStages - 1;
+	int32_t numChannels = ch->numChannels;
+	int64_t produced = 0, done, used;
 
-	// https://www.mathworks.com/help/signal/ug/kaiser-window.html
-	if (sidelobeHeight > 50)
-		beta = 0.1102 * (sidelobeHeight - 8.7);
-	else if (sidelobeHeight >= 21)
-		beta = 0.5842 * pow(sidelobeHeight - 21.0, 0.4) + 0.07886 * (sidelobeHeight - 21.0);
+	if (last == 0)
+		return sinc_resample(&ch->st[0], wavOut, outFrames, wavIn, inFrames, inUsed, eof);
 
-	windowSize = (sidelobeHeight - 8.0) / (2.285 * transitionWidth * M_PI) + 1;
+	*inUsed = 0;
+	for (;;)
+	{
+		done = sinc_resample(&ch->st[last], (uint8_t*)wavOut + produced * ch->outFrameBytes, outFrames - produced,
+							ch->fifo[last - 1] + ch->fifoPos[last - 1] * numChannels, ch->fifoLen[last - 1] - ch->fifoPos[last - 1], &used, 0);
+		ch->fifoPos[last - 1] += used;
+		produced += done;
+		if (produced == outFrames || !sinc_chain_fill(ch, last - 1, wavIn, inFrames, inUsed, eof))
+			return produced;
+	}
+}
 
-	if (windowSize > MAX_SINC_WINDOW_SIZE)
-		windowSize = MAX_SINC_WINDOW_SIZE;
+// ******************************************************************************
+// threaded whole buffer resampling. the output is cut into chunks that workers
+// take in order, each one seeking its chain to the chunk start, so chunks don't
+// depend on each other. the error feedback dither does, so 8 and 16 bit chunks
+// are filtered into float slots and quantized in order by the calling thread.
+// the result is identical to the single threaded path.
+// planar sounds with fewer chunks than threads also split each chunk into
+// channel groups, so a short many channel sound still spreads over every thread.
+
+typedef struct _sincJob {
+	const swsContext *ctx;
+	const uint8_t *wavIn;
+	uint8_t *wavOut;
+	int64_t inFrames;
+	int64_t outFrames;
+	int32_t numChannels;
+	int32_t bits;
+	int32_t outBits;
+	int32_t frameBytes;
+	int32_t outFrameBytes;
+	int32_t raw;
+	int32_t groups;
+	int32_t groupSize;
+	int32_t slots;
+	float *slotData;
+	int32_t *slotReady;
+	int64_t numChunks;
+	int64_t nextUnit;
+	int64_t quantized;
+	// the workers' stats when the caller has some attached, each worker adds its
+	// own in when done and the caller adds the total to its own once they joined
+	int32_t counting;
+	swsStats stats;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} sincJob;
+
+static void* sinc_job_worker(void *arg) {
+	sincJob *job = (sincJob*)arg;
+	swsStats stats;
+	sincChain ch;
+
+	memset(&stats, 0, sizeof(stats));
+	if (job->counting)
+		swsStatsAttach(&stats);
+	sinc_chain_init(&ch, job->ctx, job->numChannels, job->bits, job->raw ? SINC_RAW : job->outBits,
+					sinc_gain(job->bits, job->outBits));
+
+	pthread_mutex_lock(&job->lock);
+	while (job->nextUnit < job->numChunks * job->groups)
+	{
+		int64_t k = job->nextUnit / job->groups;
+		int32_t g = job->nextUnit % job->groups;
+		int64_t start = k * THREAD_CHUNK_FRAMES;
+		int64_t frames = job->outFrames - start;
+		int64_t next, inUsed;
+		int32_t c0, c1;
+		double started;
+		void *dst;
+
+		// wait for the quantizer to free a slot
+		if (job->raw && k >= job->quantized + job->slots) {
+			pthread_cond_wait(&job->cond, &job->lock);
+			continue;
+		}
+		job->nextUnit++;
+		pthread_mutex_unlock(&job->lock);
+
+		if (frames > THREAD_CHUNK_FRAMES) frames = THREAD_CHUNK_FRAMES;
+		c0 = g * job->groupSize;
+		c1 = c0 + job->groupSize;
+		if (c1 > job->numChannels) c1 = job->numChannels;
+		sinc_chain_channels(&ch, c0, c1);
+		next = sinc_chain_seek(&ch, start);
+		if (next > job->inFrames) next = job->inFrames;
+		if (job->raw)
+			dst = job->slotData + (k % job->slots) * THREAD_CHUNK_FRAMES * job->numChannels;
+		else
+			dst = job->wavOut + start * job->outFrameBytes;
+		started = sinc_kernel_start();
+		sinc_chain_run(&ch, dst, frames, job->wavIn + next * job->frameBytes, job->inFrames - next, &inUsed, 1);
+		sinc_kernel_end(started);
+
+		pthread_mutex_lock(&job->lock);
+		if (job->raw) {
+			job->slotReady[k % job->slots]++;
+			pthread_cond_broadcast(&job->cond);
+		}
+	}
+	pthread_mutex_unlock(&job->lock);
 
-	// should compile as different paths
-	// number of channels need to be compiled as separate paths to ensure good
-	// vectorization by the compiler
-	if (numChannels == 1)
-		sinc_resampleF_internal(wavOut, sizeOut, outFreq, wavIn, sizeIn, inFreq, cutoffFreq2, 1, windowSize, beta);
-	else if (numChannels == 2)
-		sinc_resampleF_internal(wavOut, sizeOut, outFreq, wavIn, sizeIn, inFreq, cutoffFreq2, 2, windowSize, beta);
-	else
-		sinc_resampleF_internal(wavOut, sizeOut, outFreq, wavIn, sizeIn, inFreq, cutoffFreq2, numChannels, windowSize, beta);	
+	sinc_chain_free(&ch);
+	if (job->counting) {
+		pthread_mutex_lock(&job->lock);
+		swsStatsAdd(&job->stats, &stats);
+		pthread_mutex_unlock(&job->lock);
+	}
+	return NULL;
 }
 
-void swsResampleSnd8(wavSound *in, wavSound* out, int32_t freq, xmalloc xm) {
-	int32_t gcd = calc_gcd(freq, in->sampleRate);
+static void sinc_resample_threaded(const swsContext *ctx, wavSound *in, wavSound *out,
+						int64_t inFrames, int64_t outFrames, int32_t threads) {
+	sincJob job;
+	pthread_t tid[threads];
+	float dither[in->channels];
+	int64_t k;
+	int32_t t, c;
+
+	memset(&job, 0, sizeof(job));
+	job.ctx = ctx;
+	job.counting = (sinc_stats != NULL);
+	job.wavIn = in->data.bytes;
+	job.wavOut = out->data.bytes;
+	job.inFrames = inFrames;
+	job.outFrames = outFrames;
+	job.numChannels = in->channels;
+	job.bits = in->bitsPerSample;
+	job.outBits = out->bitsPerSample;
+	job.frameBytes = sinc_frame_bytes(in->bitsPerSample, in->channels);
+	job.outFrameBytes = sinc_frame_bytes(out->bitsPerSample, in->channels);
+	job.raw = (job.outBits == 8 || job.outBits == 16);
+	job.numChunks = (outFrames + THREAD_CHUNK_FRAMES - 1) / THREAD_CHUNK_FRAMES;
+	job.groups = 1;
+	if (job.numChannels > 2 && job.numChunks < threads) {
+		job.groups = (threads + job.numChunks - 1) / job.numChunks;
+		if (job.groups > job.numChannels) job.groups = job.numChannels;
+	}
+	job.groupSize = (job.numChannels + job.groups - 1) / job.groups;
+	job.groups = (job.numChannels + job.groupSize - 1) / job.groupSize;
+	if (job.raw) {
+		job.slots = threads * 2;
+		job.slotData = sinc_malloc(sizeof(float) * job.slots * THREAD_CHUNK_FRAMES * job.numChannels);
+		job.slotReady = sinc_calloc(job.slots, sizeof(int32_t));
+		if (job.slotData == NULL || job.slotReady == NULL) wavFatal("swsResampleSndMT() allocation failure");
+	}
+	pthread_mutex_init(&job.lock, NULL);
+	pthread_cond_init(&job.cond, NULL);
 
-	if (xm == NULL) xm = malloc;
+	for (t = 0; t < threads; t++)
+	{
+		if (pthread_create(&tid[t], NULL, sinc_job_worker, &job) != 0)
+			wavFatal("swsResampleSndMT() thread creation failure");
+	}
 
-	out->data.numBytes = in->data.numBytes * (int64_t)(freq / gcd) / (int64_t)(in->sampleRate / gcd);
-	out->data.bytes = xm(out->data.numBytes);
-	if (out->data.bytes == NULL) wavFatal("swsResampleSnd8() allocation failure");
-	out->sampleRate = freq;
-	out->channels = in->channels;
-	out->bitsPerSample = 8;
+	if (job.raw) {
+		for (c = 0; c < job.numChannels; c++)
+			dither[c] = 0.0f;
 
-	sinc_resample8((uint8_t*)out->data.bytes, out->data.numBytes, out->sampleRate, (uint8_t*)in->data.bytes, 
-						in->data.numBytes, in->sampleRate, in->channels);
+		for (k = 0; k < job.numChunks; k++)
+		{
+			int32_t slot = k % job.slots;
+			int64_t start = k * THREAD_CHUNK_FRAMES;
+			int64_t frames = outFrames - start;
+
+			pthread_mutex_lock(&job.lock);
+			while (job.slotReady[slot] < job.groups)
+				pthread_cond_wait(&job.cond, &job.lock);
+			pthread_mutex_unlock(&job.lock);
+
+			if (frames > THREAD_CHUNK_FRAMES) frames = THREAD_CHUNK_FRAMES;
+			sinc_quantize(job.wavOut + start * job.outFrameBytes, job.slotData + slot * THREAD_CHUNK_FRAMES * job.numChannels,
+							frames, dither, job.numChannels, job.outBits);
+
+			pthread_mutex_lock(&job.lock);
+			job.slotReady[slot] = 0;
+			job.quantized++;
+			pthread_cond_broadcast(&job.cond);
+			pthread_mutex_unlock(&job.lock);
+		}
+	}
+
+	for (t = 0; t < threads; t++)
+		pthread_join(tid[t], NULL);
+	if (job.counting)
+		swsStatsAdd(sinc_stats, &job.stats);
+
+	pthread_mutex_destroy(&job.lock);
+	pthread_cond_destroy(&job.cond);
+	free(job.slotData);
+	free(job.slotReady);
 }
 
-void swsResampleSnd16(wavSound *in, wavSound* out, int32_t freq, xmalloc xm) {
-	int32_t gcd = calc_gcd(freq, in->sampleRate);
+int32_t swsCpuCount(void) {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
 
+	return (n > 0) ? n : 1;
+#endif
+}
+
+void swsResampleSndTo(const swsContext *ctx, wavSound *in, wavSound* out, int32_t bits, int32_t threads, xmalloc xm) {
+	int32_t frameBytes = sinc_frame_bytes(in->bitsPerSample, in->channels);
+	int64_t inFrames = in->data.numBytes / frameBytes;
+	int64_t outFrames = sinc_out_frames(ctx, inFrames);
+	int64_t inUsed;
+	double start;
+	sincChain ch;
+
+	if (in->sampleRate != ctx->inFreq) wavFatal("swsResampleSnd() input rate does not match context");
+	if (bits == 0) bits = in->bitsPerSample;
+	if (!sinc_valid_bits(bits)) wavFatal("swsResampleSnd() unsupported output bits");
 	if (xm == NULL) xm = malloc;
 
-	out->data.numBytes = in->data.numBytes * (int64_t)(freq / gcd) / (int64_t)(in->sampleRate / gcd);
+	out->data.numBytes = outFrames * sinc_frame_bytes(bits, in->channels);
 	out->data.bytes = xm(out->data.numBytes);
-	if (out->data.bytes == NULL) wavFatal("swsResampleSnd16() allocation failure");
-	out->sampleRate = freq;
+	if (out->data.bytes == NULL) wavFatal("swsResampleSnd() allocation failure");
+	out->sampleRate = ctx->outFreq;
 	out->channels = in->channels;
-	out->bitsPerSample = 16;
+	out->bitsPerSample = bits;
+	if (sinc_stats) {
+		sinc_stats_alloc(out->data.numBytes);
+		sinc_stats->framesIn += inFrames;
+		sinc_stats->framesOut += outFrames;
+		sinc_stats->bytesIn += inFrames * frameBytes;
+		sinc_stats->bytesOut += out->data.numBytes;
+	}
+
+	// Just copy if no resampling necessary
+	if (ctx->inFreq == ctx->outFreq) {
+		float dither[in->channels];
+
+		start = sinc_stats_clock();
+		if (bits == in->bitsPerSample)
+			memcpy(out->data.bytes, in->data.bytes, out->data.numBytes);
+		else {
+			memset(dither, 0, sizeof(dither));
+			sinc_convert(out->data.bytes, in->data.bytes, inFrames, dither, in->channels, in->bitsPerSample, bits);
+		}
+		if (sinc_stats)
+			sinc_stats->convertTime += swsStatsClock() - start;
+		return;
+	}
+
+	// no point in more threads than chunks, or channels of them when planar
+	if (threads <= 0) threads = swsCpuCount();
+	if (threads > (outFrames + THREAD_CHUNK_FRAMES - 1) / THREAD_CHUNK_FRAMES * (in->channels > 2 ? in->channels : 1))
+		threads = (outFrames + THREAD_CHUNK_FRAMES - 1) / THREAD_CHUNK_FRAMES * (in->channels > 2 ? in->channels : 1);
+
+	if (threads > 1) {
+		sinc_resample_threaded(ctx, in, out, inFrames, outFrames, threads);
+		return;
+	}
+
+	sinc_chain_init(&ch, ctx, in->channels, in->bitsPerSample, bits, sinc_gain(in->bitsPerSample, bits));
+	start = sinc_kernel_start();
+	sinc_chain_run(&ch, out->data.bytes, outFrames, in->data.bytes, inFrames, &inUsed, 1);
+	sinc_kernel_end(start);
+	sinc_chain_free(&ch);
+}
 
-	sinc_resample16((int16_t*)out->data.bytes, out->data.numBytes, out->sampleRate, (int16_t*)in->data.bytes, 
-						in->data.numBytes, in->sampleRate, in->channels);
+void swsResampleSndMT(const swsContext *ctx, wavSound *in, wavSound* out, int32_t threads, xmalloc xm) {
+	swsResampleSndTo(ctx, in, out, in->bitsPerSample, threads, xm);
 }
 
-void swsResampleSndF(wavSound *in, wavSound* out, int32_t freq, xmalloc xm) {
-	int32_t gcd = calc_gcd(freq, in->sampleRate);
+void swsResampleSnd(const swsContext *ctx, wavSound *in, wavSound* out, xmalloc xm) {
+	swsResampleSndTo(ctx, in, out, in->bitsPerSample, 1, xm);
+}
 
-	if (xm == NULL) xm = malloc;
+// ******************************************************************************
+// streaming
+
+struct _swsStream {
+	sincChain ch;
+	const swsContext *ctx;
+	int32_t frameBytes;
+	int32_t outFrameBytes;
+	int32_t numChannels;
+	int32_t bits;
+	int32_t outBits;
+	// the format change when the rates match and the ratio is fixed, there is no
+	// chain then
+	float *dither;
+	int32_t flushed;
+	int64_t bytesIn;
+	int64_t framesOut;
+	uint8_t *queue;
+	size_t queuePos;
+	size_t queueLen;
+	size_t queueCap;
+};
+
+static inline int32_t sinc_stream_chained(const swsContext *ctx) {
+	return ctx->inFreq != ctx->outFreq || ctx->variable;
+}
 
-	out->data.numBytes = in->data.numBytes * (int64_t)(freq / gcd) / (int64_t)(in->sampleRate / gcd);
-	out->data.bytes = xm(out->data.numBytes);
-	if (out->data.bytes == NULL) wavFatal("swsResampleSndF() allocation failure");
-	out->sampleRate = freq;
-	out->channels = in->channels;
-	out->bitsPerSample = in->bitsPerSample;
+swsStream* swsStreamCreateTo(const swsContext *ctx, int32_t channels, int32_t bitsPerSample, int32_t outBits) {
+	swsStream *s = sinc_calloc(1, sizeof(swsStream));
+
+	if (s == NULL) wavFatal("swsStreamCreate() allocation failure");
+	if (outBits == 0) outBits = bitsPerSample;
+	if (!sinc_valid_bits(outBits)) wavFatal("swsStreamCreate() unsupported output bits");
+	s->ctx = ctx;
+	s->frameBytes = sinc_frame_bytes(bitsPerSample, channels);
+	s->outFrameBytes = sinc_frame_bytes(outBits, channels);
+	s->numChannels = channels;
+	s->bits = bitsPerSample;
+	s->outBits = outBits;
+	if (sinc_stream_chained(ctx))
+		sinc_chain_init(&s->ch, ctx, channels, bitsPerSample, outBits, sinc_gain(bitsPerSample, outBits));
+	else if ((s->dither = sinc_calloc(channels, sizeof(float))) == NULL)
+		wavFatal("swsStreamCreate() allocation failure");
+
+	// starts at the nominal ratio, inFreq / outFreq input frames an output frame
+	// by long division, to the last bit of the fraction
+	if (ctx->variable) {
+		uint64_t rem = ((uint64_t)(ctx->inFreq % ctx->outFreq) << 32);
+		uint64_t hi = rem / ctx->outFreq;
+
+		rem = (rem % ctx->outFreq) << 32;
+		s->ch.st[0].vary = 1;
+		sinc_vary_set(&s->ch.st[0], ctx->inFreq / ctx->outFreq, (hi << 32) | (rem / ctx->outFreq), 0);
+	}
+	return s;
+}
 
-	sinc_resampleF((float*)out->data.bytes, out->data.numBytes, out->sampleRate, (float*)in->data.bytes, 
-						in->data.numBytes, in->sampleRate, in->channels);
+swsStream* swsStreamCreate(const swsContext *ctx, int32_t channels, int32_t bitsPerSample) {
+	return swsStreamCreateTo(ctx, channels, bitsPerSample, bitsPerSample);
 }
 
-void swsResampleSnd(wavSound *in, wavSound* out, int32_t freq, xmalloc xm) {
-	switch (in->bitsPerSample) {
-		case 32:
-		case 24:
-			swsResampleSndF(in, out, freq, xm);
-			break;
-		case 16:
-			swsResampleSnd16(in, out, freq, xm);
-			break;
-		case 8:
-			swsResampleSnd8(in, out, freq, xm);
-			break;
+void swsStreamFree(swsStream *s) {
+	if (s == NULL) return;
+	if (sinc_stream_chained(s->ctx))
+		sinc_chain_free(&s->ch);
+	free(s->dither);
+	free(s->queue);
+	free(s);
+}
+
+void swsStreamPush(swsStream *s, const void *data, size_t numBytes) {
+	size_t held = s->queueLen - s->queuePos;
+
+	if (s->flushed) wavFatal("swsStreamPush() called after swsStreamFlush()");
+
+	// drop what the kernel already consumed before growing
+	if (s->queuePos > 0) {
+		memmove(s->queue, s->queue + s->queuePos, held);
+		s->queuePos = 0;
+		s->queueLen = held;
+	}
+	if (held + numBytes > s->queueCap) {
+		size_t cap = s->queueCap ? s->queueCap : 4096;
+		uint8_t *q;
+
+		while (cap < held + numBytes) cap <<= 1;
+		q = sinc_realloc(s->queue, cap);
+		if (q == NULL) wavFatal("swsStreamPush() allocation failure");
+		s->queue = q;
+		s->queueCap = cap;
+	}
+	memcpy(s->queue + s->queueLen, data, numBytes);
+	s->queueLen += numBytes;
+	s->bytesIn += numBytes;
+	if (sinc_stats) {
+		sinc_stats->framesIn += numBytes / s->frameBytes;
+		sinc_stats->bytesIn += numBytes;
+	}
+}
+
+size_t swsStreamPull(swsStream *s, void *out, size_t numBytes) {
+	int64_t avail = (s->queueLen - s->queuePos) / s->frameBytes;
+	int64_t outFrames = numBytes / s->outFrameBytes;
+	int64_t left = sinc_out_frames(s->ctx, s->bytesIn / s->frameBytes) - s->framesOut;
+	int64_t inUsed, done;
+	double start;
+
+	// never run past the frame count the whole buffer path would produce, a
+	// variable ratio has none and the kernel stops at the end of the input itself
+	if (outFrames > left && !s->ctx->variable) outFrames = left;
+	if (outFrames <= 0) return 0;
+
+	if (!sinc_stream_chained(s->ctx)) {
+		start = sinc_stats_clock();
+		done = (outFrames < avail) ? outFrames : avail;
+		if (s->outBits == s->bits)
+			memcpy(out, s->queue + s->queuePos, done * s->frameBytes);
+		else
+			sinc_convert(out, s->queue + s->queuePos, done, s->dither, s->numChannels, s->bits, s->outBits);
+		inUsed = done;
+		if (sinc_stats)
+			sinc_stats->convertTime += swsStatsClock() - start;
+	} else {
+		start = sinc_kernel_start();
+		done = sinc_chain_run(&s->ch, out, outFrames, s->queue + s->queuePos, avail, &inUsed, s->flushed);
+		sinc_kernel_end(start);
+	}
+
+	s->queuePos += inUsed * s->frameBytes;
+	s->framesOut += done;
+	if (sinc_stats) {
+		sinc_stats->framesOut += done;
+		sinc_stats->bytesOut += done * s->outFrameBytes;
+	}
+	return done * s->outFrameBytes;
+}
+
+void swsStreamFlush(swsStream *s) {
+	s->flushed = 1;
+}
+
+void swsStreamSetRatio(swsStream *s, double ratio, int32_t rampFrames) {
+	double step = 1.0 / ratio, whole = floor(step);
+	double frac = ldexp(step - whole, 64);
+
+	if (!s->ctx->variable) wavFatal("swsStreamSetRatio() needs a context from swsContextCreateVariable()");
+	if (!(ratio > 0.0) || step >= 0x1p30) wavFatal("swsStreamSetRatio() invalid ratio");
+	// step - whole rounds up to 1 just below a whole frame
+	sinc_vary_set(&s->ch.st[0], whole, (frac >= 0x1p64) ? UINT64_MAX : (uint64_t)frac, rampFrames);
+}
+
+double swsStreamGetRatio(const swsStream *s) {
+	const sincState *st = &s->ch.st[0];
+
+	if (!s->ctx->variable)
+		return (double)s->ctx->outFreq / s->ctx->inFreq;
+	return 1.0 / (st->stepWhole + st->stepFrac * 0x1p-64);
+}
+
+// samples of one format to another with the dsp format kernels, through a block of
+// float unless one side is float already
+static void sinc_convert_samples(void *out, int32_t outBits, const void *in, int32_t inBits, int64_t samples) {
+	const swsDsp *dsp = swsDspBest();
+	float block[SINC_PACK_FRAMES];
+	int64_t i, n;
+
+	// 24 bit is float internally
+	if (inBits == 24) inBits = 32;
+	if (outBits == 24) outBits = 32;
+	if (inBits == 32) {
+		dsp->store(out, in, samples, outBits);
+		return;
+	} else if (outBits == 32) {
+		dsp->load(out, in, samples, inBits);
+		return;
+	}
+	for (i = 0; i < samples; i += n)
+	{
+		n = (samples - i < SINC_PACK_FRAMES) ? samples - i : SINC_PACK_FRAMES;
+		dsp->load(block, (const uint8_t*)in + i * sinc_frame_bytes(inBits, 1), n, inBits);
+		dsp->store((uint8_t*)out + i * sinc_frame_bytes(outBits, 1), block, n, outBits);
 	}
 }
 
@@ -613,26 +2361,20 @@ void swsConvertSndF(wavSound *in, wavSound* out, int32_t bits, xmalloc xm) {
 	int32_t samples = (in->data.numBytes >> 2) / in->channels;
 	int32_t c = in->channels;
 	float *inf = (float*)in->data.bytes;
-	int16_t *o16;
-	uint8_t *o8;
 	switch (bits) {
 		case 8:
 			out->bitsPerSample = 8;
 			out->data.numBytes = in->data.numBytes >> 2;
 			out->data.bytes = xm(out->data.numBytes);
 			if (out->data.bytes == NULL) wavFatal("swsConvertSndF() allocation failure (8)");
-			samples *= c;
-			o8 = (uint8_t*)out->data.bytes;
-			while (samples--) *o8++ = (uint8_t)(((*inf++) + 1.0f) * 127.5f); 
+			sinc_convert_samples(out->data.bytes, 8, inf, 32, (int64_t)samples * c);
 			break;
 		case 16:
 			out->bitsPerSample = 16;
 			out->data.numBytes = in->data.numBytes >> 1;
 			out->data.bytes = xm(out->data.numBytes);
 			if (out->data.bytes == NULL) wavFatal("swsConvertSndF() allocation failure (16)");
-			o16 = (int16_t*)out->data.bytes;
-			samples *= c;
-			while (samples--) *o16++ = (int16_t)((*inf++) * 32767.0f);
+			sinc_convert_samples(out->data.bytes, 16, inf, 32, (int64_t)samples * c);
 			break;
 		case 24:
 		case 32:
@@ -642,6 +2384,14 @@ void swsConvertSndF(wavSound *in, wavSound* out, int32_t bits, xmalloc xm) {
 			if (out->data.bytes == NULL) wavFatal("swsConvertSndF() allocation failure (F)");
 			memcpy(out->data.bytes, in->data.bytes, in->data.numBytes);
 			break;
+		case WAV_S24:
+		case WAV_S32:
+			out->bitsPerSample = bits;
+			out->data.numBytes = (in->data.numBytes >> 2) * (WAV_BITS(bits) >> 3);
+			out->data.bytes = xm(out->data.numBytes);
+			if (out->data.bytes == NULL) wavFatal("swsConvertSndF() allocation failure (P)");
+			sinc_convert_samples(out->data.bytes, bits, inf, 32, (int64_t)samples * c);
+			break;
 	}
 	out->sampleRate = in->sampleRate;
 	out->channels = in->channels;
@@ -652,7 +2402,6 @@ void swsConvertSnd16(wavSound *in, wavSound* out, int32_t bits, xmalloc xm) {
 	int32_t c = in->channels;
 	int16_t *in16 = (int16_t*)in->data.bytes;
 	uint8_t *o8;
-	float *oF;
 	switch (bits) {
 		case 8:
 			out->bitsPerSample = 8;
@@ -661,7 +2410,8 @@ void swsConvertSnd16(wavSound *in, wavSound* out, int32_t bits, xmalloc xm) {
 			if (out->data.bytes == NULL) wavFatal("swsConvertSnd16() allocation failure (8)");
 			o8 = (uint8_t*)out->data.bytes;
 			samples *= c;
-			while (samples--) *o8++ = (((float)(*in16++) / 256.0f) + 128.0f);	
+			// what (s / 256.0f + 128.0f) truncates to, without the float
+			for (int32_t i = 0; i < samples; i++) o8[i] = (uint8_t)((in16[i] >> 8) + 128);
 			break;
 		case 16:
 			out->bitsPerSample = 16;
@@ -676,9 +2426,15 @@ void swsConvertSnd16(wavSound *in, wavSound* out, int32_t bits, xmalloc xm) {
 			out->data.numBytes = in->data.numBytes << 1;
 			out->data.bytes = xm(out->data.numBytes);
 			if (out->data.bytes == NULL) wavFatal("swsConvertSnd16() allocation failure (F)");
-			samples *= c;
-			oF = (float*)out->data.bytes;
-			while (samples--) *oF++ = (float)(*in16++) / 32768.0F; 			
+			sinc_convert_samples(out->data.bytes, 32, in16, 16, (int64_t)samples * c);
+			break;
+		case WAV_S24:
+		case WAV_S32:
+			out->bitsPerSample = bits;
+			out->data.numBytes = (in->data.numBytes >> 1) * (WAV_BITS(bits) >> 3);
+			out->data.bytes = xm(out->data.numBytes);
+			if (out->data.bytes == NULL) wavFatal("swsConvertSnd16() allocation failure (P)");
+			sinc_convert_samples(out->data.bytes, bits, in16, 16, (int64_t)samples * c);
 			break;
 	}
 	out->sampleRate = in->sampleRate;
@@ -690,7 +2446,6 @@ void swsConvertSnd8(wavSound *in, wavSound* out, int32_t bits, xmalloc xm) {
 	int32_t c = in->channels;
 	uint8_t *in8 = in->data.bytes;
 	int16_t *o16;
-	float *oF;
 	switch (bits) {
 		case 8:
 			out->bitsPerSample = 8;
@@ -706,7 +2461,7 @@ void swsConvertSnd8(wavSound *in, wavSound* out, int32_t bits, xmalloc xm) {
 			if (out->data.bytes == NULL) wavFatal("swsConvertSnd8() allocation failure (16)");
 			o16 = (int16_t*)out->data.bytes;
 			samples *= c;
-			while (samples--) *o16++ = (int16_t)(((float)(*in8++) - 128.0f) * 256.0f);
+			for (int32_t i = 0; i < samples; i++) o16[i] = (int16_t)((in8[i] - 128) * 256);
 			break;
 		case 24:
 		case 32:
@@ -714,22 +2469,89 @@ void swsConvertSnd8(wavSound *in, wavSound* out, int32_t bits, xmalloc xm) {
 			out->data.numBytes = in->data.numBytes << 2;
 			out->data.bytes = xm(out->data.numBytes);
 			if (out->data.bytes == NULL) wavFatal("swsConvertSnd8() allocation failure (F)");
-			samples *= c;
-			oF = (float*)out->data.bytes;
-			while (samples--) *oF++ = ((float)(*in8++) / 127.0f) - 1.0f; 			
+			sinc_convert_samples(out->data.bytes, 32, in8, 8, (int64_t)samples * c);
+			break;
+		case WAV_S24:
+		case WAV_S32:
+			out->bitsPerSample = bits;
+			out->data.numBytes = in->data.numBytes * (WAV_BITS(bits) >> 3);
+			out->data.bytes = xm(out->data.numBytes);
+			if (out->data.bytes == NULL) wavFatal("swsConvertSnd8() allocation failure (P)");
+			sinc_convert_samples(out->data.bytes, bits, in8, 8, (int64_t)samples * c);
 			break;
 	}
 	out->sampleRate = in->sampleRate;
 	out->channels = in->channels;	
 }
 
+// packed input, each sample is unpacked to the float the float layout holds and
+// converted the way swsConvertSndF() does
+void swsConvertSndP(wavSound *in, wavSound* out, int32_t bits, xmalloc xm) {
+	int32_t inBits = in->bitsPerSample;
+	int64_t samples = in->data.numBytes / (WAV_BITS(inBits) >> 3);
+
+	switch (bits) {
+		case 8:
+			out->bitsPerSample = 8;
+			out->data.numBytes = samples;
+			out->data.bytes = xm(out->data.numBytes);
+			if (out->data.bytes == NULL) wavFatal("swsConvertSndP() allocation failure (8)");
+			sinc_convert_samples(out->data.bytes, 8, in->data.bytes, inBits, samples);
+			break;
+		case 16:
+			out->bitsPerSample = 16;
+			out->data.numBytes = samples * 2;
+			out->data.bytes = xm(out->data.numBytes);
+			if (out->data.bytes == NULL) wavFatal("swsConvertSndP() allocation failure (16)");
+			sinc_convert_samples(out->data.bytes, 16, in->data.bytes, inBits, samples);
+			break;
+		case 24:
+		case 32:
+			out->bitsPerSample = bits;
+			out->data.numBytes = samples * 4;
+			out->data.bytes = xm(out->data.numBytes);
+			if (out->data.bytes == NULL) wavFatal("swsConvertSndP() allocation failure (F)");
+			sinc_convert_samples(out->data.bytes, 32, in->data.bytes, inBits, samples);
+			break;
+		case WAV_S24:
+		case WAV_S32:
+			out->bitsPerSample = bits;
+			out->data.numBytes = samples * (WAV_BITS(bits) >> 3);
+			out->data.bytes = xm(out->data.numBytes);
+			if (out->data.bytes == NULL) wavFatal("swsConvertSndP() allocation failure (P)");
+			if (bits == inBits)
+				memcpy(out->data.bytes, in->data.bytes, in->data.numBytes);
+			else
+				sinc_convert_samples(out->data.bytes, bits, in->data.bytes, inBits, samples);
+			break;
+	}
+	out->sampleRate = in->sampleRate;
+	out->channels = in->channels;
+}
+
 void swsConvertSnd(wavSound *in, wavSound* out, int32_t bits, xmalloc xm) {
+	double start = sinc_stats_clock();
+
 	if (xm == NULL) xm = malloc;
-	if (in->bitsPerSample == 32 || in->bitsPerSample == 24)
+	if (in->bitsPerSample & WAV_PACKED)
+		swsConvertSndP(in, out, bits, xm);
+	else if (in->bitsPerSample == 32 || in->bitsPerSample == 24)
 		swsConvertSndF(in, out, bits, xm);
 	else if (in->bitsPerSample == 16)
 		swsConvertSnd16(in, out, bits, xm);
 	else if (in->bitsPerSample == 8)
 		swsConvertSnd8(in, out, bits, xm);
+	else
+		return;
+	if (sinc_stats && sinc_valid_bits(bits)) {
+		int64_t frames = in->data.numBytes / sinc_frame_bytes(in->bitsPerSample, in->channels);
+
+		sinc_stats->convertTime += swsStatsClock() - start;
+		sinc_stats_alloc(out->data.numBytes);
+		sinc_stats->framesIn += frames;
+		sinc_stats->framesOut += frames;
+		sinc_stats->bytesIn += in->data.numBytes;
+		sinc_stats->bytesOut += out->data.numBytes;
+	}
 }
 
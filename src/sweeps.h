@@ -27,6 +27,11 @@
 		int32_t bitsPerSample;
 	} wavSound;
 
+	#define WAV_PACKED		0x100
+	#define WAV_S24			(WAV_PACKED | 24)
+	#define WAV_S32			(WAV_PACKED | 32)
+	#define WAV_BITS(x)		((x) & 0xFF)
+
 	typedef void* (*xmalloc)(size_t x);
 	typedef void (*xfatal)(const char *);
 
@@ -40,6 +45,132 @@
 	static void __attribute__((unused)) setWavFatal(xfatal func) { wavFatal = func; }
 #endif
 
-void swsResampleSnd(wavSound *in, wavSound* out, int32_t freq, xmalloc xm);
+// filter design, a Kaiser windowed sinc. attenuation is the stopband rejection
+// in dB, the transition widths are the width of the band between pass and stop
+// as a fraction of the input rate, for up and down sampling. taps scale with
+// attenuation / width, so lower quality is a lot faster. minPhase swaps the
+// linear phase filter for the minimum phase one with the same magnitude: no
+// lookahead, so a stream makes each frame as soon as its input is in, at the cost
+// of a group delay that varies with frequency. the presets are linear phase.
+typedef struct _swsQuality {
+	double attenuation;
+	double upTransition;
+	double downTransition;
+	int32_t minPhase;
+} swsQuality;
+
+#define SWS_QUALITY_DRAFT		0	// 40 dB, previews
+#define SWS_QUALITY_VOICE		1	// 60 dB, speech
+#define SWS_QUALITY_BROADCAST	2	// 80 dB
+#define SWS_QUALITY_MASTERING	3	// 96 dB, the default
+
+void swsQualityPreset(swsQuality *q, int32_t preset);
+
+// a context holds the designed filter for one input / output rate pair. it is
+// read only once created, so one context can be shared by any number of threads
+// and conversions running at once. quality may be NULL for mastering.
+typedef struct _swsContext swsContext;
+
+swsContext* swsContextCreate(int32_t inFreq, int32_t outFreq, const swsQuality *quality);
+void swsContextFree(swsContext *ctx);
+// the kernel choices a context makes itself, forced one way or the other to test and
+// measure the faster paths against the plain ones. a forced choice that doesn't
+// apply (a dsp level this cpu can't run, the fixed point kernel on float input) is
+// ignored.
+#define SWS_FORCE_SINGLE		0x01	// one stage, never a cascade
+#define SWS_FORCE_DIRECT		0x02	// dot product, never overlap-save
+#define SWS_FORCE_LUT			0x04	// interpolated lut even where a bank fits
+#define SWS_FORCE_LUT16			0x08	// fp16 lut at any attenuation
+#define SWS_FORCE_LUT32			0x10	// fp32 lut at any attenuation
+#define SWS_FORCE_FIXED			0x20	// 16 bit bank for 8 and 16 bit input at any attenuation
+#define SWS_FORCE_FLOAT			0x40	// never the 16 bit bank
+#define SWS_FORCE_DSP(level)	(((level) + 1) << 8)	// kernels of one swsdsp.h level
+
+swsContext* swsContextCreateForced(int32_t inFreq, int32_t outFreq, const swsQuality *quality, int32_t force);
+// a context for variable ratio streams, see swsStreamSetRatio(). one interpolated lut
+// stage designed for the nominal inFreq to outFreq, made even when the two match.
+// the whole buffer calls use it as a plain fixed ratio context.
+swsContext* swsContextCreateVariable(int32_t inFreq, int32_t outFreq, const swsQuality *quality);
+// the latency of the context's filters in input frames, at worst, from an input
+// frame arriving to the output frames it makes leaving a stream: the input each
+// stage needs past an output frame before it can make it, plus for minimum phase
+// the group delay at DC. linear phase output lines up with the input, minimum
+// phase output is late by that group delay, the whole buffer calls included.
+double swsContextLatency(const swsContext *ctx);
+// keep designed filter tables in this directory (created if missing) and map them
+// from there on later runs instead of redesigning. NULL turns it off, the default.
+// set it before creating contexts, it is not safe to change while they are built.
+void swsSetCacheDir(const char *dir);
+
+// in->sampleRate must match the inFreq the context was created with
+void swsResampleSnd(const swsContext *ctx, wavSound *in, wavSound* out, xmalloc xm);
+// same, split across threads (0 for one per cpu), the output is bit identical
+void swsResampleSndMT(const swsContext *ctx, wavSound *in, wavSound* out, int32_t threads, xmalloc xm);
+// resample and convert in one pass, out gets bits (as swsConvertSnd(), 0 keeps the
+// input's) rounded straight from the filter sums, no intermediate sound is made
+void swsResampleSndTo(const swsContext *ctx, wavSound *in, wavSound* out, int32_t bits, int32_t threads, xmalloc xm);
+int32_t swsCpuCount(void);
+// bits is 8, 16, 24 or 32 (float), or WAV_S24 / WAV_S32 for packed integers. the
+// resamplers take packed sounds too (see wavLoadFilePacked) and unpack them as they
+// go, with the same result as the float layout but no float copy of the input.
 void swsConvertSnd(wavSound *in, wavSound* out, int32_t bits, xmalloc xm);
 
+// streaming resampler, keeps the filter history between calls so input can be
+// fed in chunks as it arrives. data is in the same layout as wavSound.data (24 and
+// 32 bit as float, WAV_S24 and WAV_S32 packed). push any amount of input, pull as
+// much output as is ready, flush once the input has ended and keep pulling until
+// it returns 0. the output is identical to swsResampleSnd() on the whole input.
+// the context must outlive the stream.
+typedef struct _swsStream swsStream;
+
+swsStream* swsStreamCreate(const swsContext *ctx, int32_t channels, int32_t bitsPerSample);
+// pulls outBits instead, see swsResampleSndTo()
+swsStream* swsStreamCreateTo(const swsContext *ctx, int32_t channels, int32_t bitsPerSample, int32_t outBits);
+void swsStreamFree(swsStream *s);
+void swsStreamPush(swsStream *s, const void *data, size_t numBytes);
+size_t swsStreamPull(swsStream *s, void *out, size_t numBytes);
+void swsStreamFlush(swsStream *s);
+// variable ratio, to lock two free running clocks together. a stream on a context
+// from swsContextCreateVariable() keeps its place as a 64 bit fraction of an input
+// frame instead of the reduced integer ratio, so the ratio can be any value and
+// change between pulls. ratio is output frames per input frame, outFreq / inFreq to
+// start, moved linearly over the next rampFrames output frames (0 at once). keep it
+// near the nominal ratio, the filter's cutoff doesn't follow it. the output is no
+// longer the swsResampleSnd() one, it ends where the input ends once flushed.
+void swsStreamSetRatio(swsStream *s, double ratio, int32_t rampFrames);
+// the ratio now, partway through a ramp
+double swsStreamGetRatio(const swsStream *s);
+
+
+// where the time and memory of a conversion go. attach one to a thread and every
+// library call that thread makes adds to it, until it is detached with NULL. times
+// are seconds on swsStatsClock(): lutTime designs or maps filter tables in
+// swsContextCreate(), decodeTime unpacks packed input a block at a time,
+// convertTime packs, quantizes and converts formats, kernelTime is the filter and
+// everything else the call did. 8 and 16 bit input and output are read and rounded
+// inside the filter loop, on one thread that counts as kernel. calls split across
+// threads round on the calling thread, as convert, and add up the time of every
+// thread, so the stages can sum to more than the wall time. readTime and writeTime
+// are left to the caller, the library never touches files. allocations are the
+// library's own, the output buffer included, not those of mwav.
+typedef struct _swsStats {
+	double readTime;
+	double decodeTime;
+	double lutTime;
+	double kernelTime;
+	double convertTime;
+	double writeTime;
+	int64_t framesIn;
+	int64_t framesOut;
+	int64_t bytesIn;
+	int64_t bytesOut;
+	int64_t allocations;
+	int64_t allocBytes;
+} swsStats;
+
+// the stats must stay valid until detached, one set can't be attached to two
+// threads at once, give each thread its own and swsStatsAdd() them after
+void swsStatsAttach(swsStats *stats);
+void swsStatsAdd(swsStats *to, const swsStats *from);
+// monotonic, in seconds
+double swsStatsClock(void);
@@ -0,0 +1,183 @@
+/*
+	swscache.c
+
+	On disk cache of designed filter tables. One file per table, a fixed header
+	holding the full key followed by the raw table, named by a hash of the key.
+	Files are written to a temporary name and renamed into place, so readers in
+	other processes only ever see complete ones.
+
+	muragami, muragami@wishray.com, Jason A. Petrasko 2024
+	MIT license: https://opensource.org/license/mit/
+*/
+
+#include "swscache.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#define getpid		_getpid
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define CACHE_MAGIC			"swstable"
+#define CACHE_ENDIAN		0x01020304
+#define CACHE_DIR_MAX		1024
+// the directory plus the longest name a table gets
+#define CACHE_PATH_MAX		(CACHE_DIR_MAX + 64)
+
+// 64 bytes, so the table after it keeps the page alignment good enough for SIMD
+typedef union _cacheHeader {
+	struct {
+		char magic[8];
+		uint32_t version;
+		uint32_t endian;
+		uint64_t bytes;
+		swsCacheKey key;
+	} h;
+	uint8_t pad[64];
+} cacheHeader;
+
+static char cacheDir[CACHE_DIR_MAX];
+static uint32_t cacheSerial;
+
+void swsCacheSetDir(const char *dir) {
+	if (dir == NULL || strlen(dir) >= CACHE_DIR_MAX)
+		cacheDir[0] = 0;
+	else
+		strcpy(cacheDir, dir);
+}
+
+static void cache_header(cacheHeader *hdr, const swsCacheKey *key, size_t bytes) {
+	memset(hdr, 0, sizeof(cacheHeader));
+	memcpy(hdr->h.magic, CACHE_MAGIC, 8);
+	hdr->h.version = SWS_CACHE_VERSION;
+	hdr->h.endian = CACHE_ENDIAN;
+	hdr->h.bytes = bytes;
+	hdr->h.key = *key;
+	hdr->h.key.pad = 0;
+}
+
+// FNV-1a of the whole header, so the name changes with the version and size too
+static void cache_path(char *path, const cacheHeader *hdr) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for (i = 0; i < sizeof(cacheHeader); i++)
+		hash = (hash ^ hdr->pad[i]) * 0x100000001b3ULL;
+	snprintf(path, CACHE_PATH_MAX, "%s/sws-%d-%d-%016llx.tbl", cacheDir, hdr->h.key.inFreq, hdr->h.key.outFreq,
+			(unsigned long long)hash);
+}
+
+const void* swsCacheLoad(const swsCacheKey *key, size_t bytes, swsCacheMap *map) {
+	char path[CACHE_PATH_MAX];
+	cacheHeader want;
+	uint8_t *base = NULL;
+	size_t size = sizeof(cacheHeader) + bytes;
+
+	map->base = NULL;
+	map->bytes = 0;
+	if (cacheDir[0] == 0) return NULL;
+	cache_header(&want, key, bytes);
+	cache_path(path, &want);
+
+#ifdef _WIN32
+	HANDLE file, mapping;
+	LARGE_INTEGER fileSize;
+
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return NULL;
+	if (!GetFileSizeEx(file, &fileSize) || (uint64_t)fileSize.QuadPart != size) {
+		CloseHandle(file);
+		return NULL;
+	}
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (mapping == NULL) return NULL;
+	// the view keeps the mapping alive on its own
+	base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+	CloseHandle(mapping);
+	if (base == NULL) return NULL;
+#else
+	struct stat sb;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0) return NULL;
+	if (fstat(fd, &sb) != 0 || (uint64_t)sb.st_size != size) {
+		close(fd);
+		return NULL;
+	}
+	base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) return NULL;
+#endif
+
+	map->base = base;
+	map->bytes = size;
+	// a hash collision or a file from another build, treat it as a miss
+	if (memcmp(base, &want, sizeof(cacheHeader))) {
+		swsCacheUnmap(map);
+		return NULL;
+	}
+	return base + sizeof(cacheHeader);
+}
+
+void swsCacheUnmap(swsCacheMap *map) {
+	if (map->base == NULL) return;
+#ifdef _WIN32
+	UnmapViewOfFile(map->base);
+#else
+	munmap(map->base, map->bytes);
+#endif
+	map->base = NULL;
+	map->bytes = 0;
+}
+
+// mkdir -p, existing directories are fine
+static void cache_mkdir(const char *dir) {
+	char path[CACHE_DIR_MAX];
+	size_t i;
+
+	strcpy(path, dir);
+	for (i = 1; path[i - 1]; i++)
+	{
+		if (path[i] == '/' || path[i] == '\\' || path[i] == 0) {
+			char c = path[i];
+
+			path[i] = 0;
+#ifdef _WIN32
+			_mkdir(path);
+#else
+			mkdir(path, 0755);
+#endif
+			path[i] = c;
+		}
+	}
+}
+
+void swsCacheStore(const swsCacheKey *key, const void *data, size_t bytes) {
+	char path[CACHE_PATH_MAX], temp[CACHE_PATH_MAX + 32];
+	cacheHeader hdr;
+	FILE *f;
+	int ok;
+
+	if (cacheDir[0] == 0) return;
+	cache_header(&hdr, key, bytes);
+	cache_path(path, &hdr);
+	cache_mkdir(cacheDir);
+
+	// unique per process and per call, contexts may be created on several threads
+	snprintf(temp, sizeof(temp), "%s.%d.%u.tmp", path, (int)getpid(), __atomic_fetch_add(&cacheSerial, 1, __ATOMIC_RELAXED));
+	f = fopen(temp, "wb");
+	if (f == NULL) return;
+	ok = fwrite(&hdr, sizeof(cacheHeader), 1, f) == 1 && fwrite(data, 1, bytes, f) == bytes;
+	ok = (fclose(f) == 0) && ok;
+	// windows won't rename over an existing file, another process got there first
+	if (!ok || rename(temp, path) != 0)
+		remove(temp);
+}
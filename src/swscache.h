@@ -0,0 +1,58 @@
+/*
+	swscache.h
+
+	On disk cache of designed filter tables, memory mapped read only so a rate
+	pair seen before starts without redesigning its filters
+
+	muragami, muragami@wishray.com, Jason A. Petrasko 2024
+	MIT license: https://opensource.org/license/mit/
+*/
+
+#ifndef SWSCACHE_H
+#define SWSCACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// bump whenever a table builder or layout changes, old files are then ignored
+#define SWS_CACHE_VERSION		3
+
+#define SWS_CACHE_BANK			1
+#define SWS_CACHE_LUT			2
+#define SWS_CACHE_FFT			3
+#define SWS_CACHE_LUT16			4
+#define SWS_CACHE_BANK_MIN		5
+#define SWS_CACHE_LUT_MIN		6
+#define SWS_CACHE_LUT16_MIN		7
+
+// everything a table depends on, a file is only used when all of it matches
+typedef struct _swsCacheKey {
+	int32_t type;
+	int32_t inFreq;
+	int32_t outFreq;
+	int32_t cutoffFreq2;
+	int32_t windowSize;
+	// phases for a bank, fft size for spectra
+	int32_t size;
+	// dsp level the spectra were transformed with, 0 otherwise
+	int32_t level;
+	int32_t pad;
+	double beta;
+} swsCacheKey;
+
+typedef struct _swsCacheMap {
+	void *base;
+	size_t bytes;
+} swsCacheMap;
+
+// NULL or "" turns the cache off, which is the default
+void swsCacheSetDir(const char *dir);
+// the table for key if the cache is on and holds a valid one of exactly bytes,
+// else NULL. the pointer stays valid until swsCacheUnmap(map).
+const void* swsCacheLoad(const swsCacheKey *key, size_t bytes, swsCacheMap *map);
+// write a freshly built table, failures are silent, the cache is only a speedup
+void swsCacheStore(const swsCacheKey *key, const void *data, size_t bytes);
+// safe on a map that was never loaded
+void swsCacheUnmap(swsCacheMap *map);
+
+#endif
@@ -0,0 +1,1306 @@
+/*
+	swsdsp.c
+
+	Filter dot product and sample format kernels for the resampler, picked at runtime
+
+	muragami, muragami@wishray.com, Jason A. Petrasko 2024
+	MIT license: https://opensource.org/license/mit/
+*/
+
+#include "swsdsp.h"
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SWS_DSP_X86
+#include <immintrin.h>
+#endif
+
+// ******************************************************************************
+// plain C, the reference and the fallback for other architectures
+
+static float dot1_scalar(const float *x, const float *h, int32_t n) {
+	float s = 0.0f;
+	int32_t i;
+
+	for (i = 0; i < n; i++)
+		s += x[i] * h[i];
+
+	return s;
+}
+
+static void dot2_scalar(const float *x, const float *h, int32_t n, float *out) {
+	float l = 0.0f, r = 0.0f;
+	int32_t i;
+
+	for (i = 0; i < n; i++)
+	{
+		l += x[i * 2] * h[i];
+		r += x[i * 2 + 1] * h[i];
+	}
+
+	out[0] += l;
+	out[1] += r;
+}
+
+static int32_t dot1i_scalar(const int16_t *x, const int16_t *h, int32_t n) {
+	int32_t s = 0;
+	int32_t i;
+
+	for (i = 0; i < n; i++)
+		s += x[i] * h[i];
+
+	return s;
+}
+
+static void dot2i_scalar(const int16_t *x, const int16_t *h, int32_t n, int32_t *out) {
+	int32_t l = 0, r = 0;
+	int32_t i;
+
+	for (i = 0; i < n; i++)
+	{
+		l += x[i * 2] * h[i];
+		r += x[i * 2 + 1] * h[i];
+	}
+
+	out[0] = l;
+	out[1] = r;
+}
+
+static void lerp_scalar(float *h, const float *value, const float *delta, float interp, int32_t n, int32_t reverse) {
+	int32_t i;
+
+	if (reverse) {
+		for (i = 0; i < n; i++)
+			h[n - 1 - i] = value[i] + delta[i] * interp;
+	} else {
+		for (i = 0; i < n; i++)
+			h[i] = value[i] + delta[i] * interp;
+	}
+}
+
+// fp16 to float is exact, subnormal halves are normal floats
+static inline float half_to_float(uint16_t x) {
+	uint32_t sign = (uint32_t)(x & 0x8000) << 16, exp = (x >> 10) & 0x1f, mant = x & 0x3ff, bits;
+	float f;
+
+	if (exp == 0) {
+		f = mant * (1.0f / 16777216.0f);
+		return sign ? -f : f;
+	}
+	if (exp == 31)
+		bits = sign | 0x7f800000 | (mant << 13);
+	else
+		bits = sign | ((exp + 112) << 23) | (mant << 13);
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+static void lerp16_scalar(float *h, const uint16_t *value, const uint16_t *delta, float interp, int32_t n, int32_t reverse) {
+	int32_t i;
+
+	if (reverse) {
+		for (i = 0; i < n; i++)
+			h[n - 1 - i] = half_to_float(value[i]) + half_to_float(delta[i]) * interp;
+	} else {
+		for (i = 0; i < n; i++)
+			h[i] = half_to_float(value[i]) + half_to_float(delta[i]) * interp;
+	}
+}
+
+static void butterfly_scalar(float *sr, float *si, float *dr, float *di, const float *ar, const float *ai,
+						const float *br, const float *bi, float cr, float ci, int32_t n) {
+	int32_t i;
+
+	for (i = 0; i < n; i++)
+	{
+		float tr = ar[i] - br[i], ti = ai[i] - bi[i];
+
+		sr[i] = ar[i] + br[i];
+		si[i] = ai[i] + bi[i];
+		dr[i] = tr * cr - ti * ci;
+		di[i] = tr * ci + ti * cr;
+	}
+}
+
+static void cmac_scalar(float *yr, float *yi, const float *xr, const float *xi, const float *hr, const float *hi, int32_t n) {
+	int32_t i;
+
+	for (i = 0; i < n; i++)
+	{
+		yr[i] += xr[i] * hr[i] - xi[i] * hi[i];
+		yi[i] += xr[i] * hi[i] + xi[i] * hr[i];
+	}
+}
+
+#define FORMAT_BYTES(x)		(((x) & 0xFF) >> 3)
+
+static void load_scalar(float *out, const void *in, int64_t n, int32_t format) {
+	const uint8_t *b = (const uint8_t*)in;
+	int64_t i;
+
+	switch (format) {
+		case SWS_DSP_U8:
+			for (i = 0; i < n; i++)
+				out[i] = (float)b[i] / 127.0f - 1.0f;
+			break;
+		case SWS_DSP_S16:
+			for (i = 0; i < n; i++)
+				out[i] = (float)((const int16_t*)in)[i] / 32768.0f;
+			break;
+		case SWS_DSP_S24:
+			for (i = 0; i < n; i++)
+				out[i] = (int32_t)((uint32_t)b[i * 3] << 8 | (uint32_t)b[i * 3 + 1] << 16 | (uint32_t)b[i * 3 + 2] << 24)
+							* (1.0f / 2147483648.0f);
+			break;
+		case SWS_DSP_S32:
+			// packed data may be a view into a file, only as aligned as its data chunk
+			for (i = 0; i < n; i++)
+			{
+				int32_t v;
+
+				memcpy(&v, b + i * 4, 4);
+				out[i] = v * (1.0f / 2147483648.0f);
+			}
+			break;
+		default:
+			memcpy(out, in, n * sizeof(float));
+	}
+}
+
+static inline int32_t store_packed(float f) {
+	if (f >= 1.0f)
+		return INT32_MAX;
+	if (f <= -1.0f)
+		return INT32_MIN;
+	return (int32_t)(f * 2147483648.0f);
+}
+
+static void store_scalar(void *out, const float *in, int64_t n, int32_t format) {
+	uint8_t *b = (uint8_t*)out;
+	int64_t i;
+
+	switch (format) {
+		case SWS_DSP_U8:
+			for (i = 0; i < n; i++)
+			{
+				float v = (in[i] + 1.0f) * 127.5f;
+
+				b[i] = (v < 0.0f) ? 0 : (v > 255.0f) ? 255 : (uint8_t)v;
+			}
+			break;
+		case SWS_DSP_S16:
+			for (i = 0; i < n; i++)
+			{
+				float v = in[i] * 32767.0f;
+
+				((int16_t*)out)[i] = (v < -32768.0f) ? -32768 : (v > 32767.0f) ? 32767 : (int16_t)v;
+			}
+			break;
+		case SWS_DSP_S24:
+			for (i = 0; i < n; i++)
+			{
+				int32_t v = store_packed(in[i]);
+
+				b[i * 3] = v >> 8;
+				b[i * 3 + 1] = v >> 16;
+				b[i * 3 + 2] = v >> 24;
+			}
+			break;
+		case SWS_DSP_S32:
+			for (i = 0; i < n; i++)
+			{
+				int32_t v = store_packed(in[i]);
+
+				memcpy(b + i * 4, &v, 4);
+			}
+			break;
+		default:
+			memcpy(out, in, n * sizeof(float));
+	}
+}
+
+static const swsDsp dspScalar = { SWS_DSP_SCALAR, "scalar", dot1_scalar, dot2_scalar, dot1i_scalar, dot2i_scalar,
+									lerp_scalar, lerp16_scalar, butterfly_scalar, cmac_scalar, load_scalar, store_scalar };
+
+#ifdef SWS_DSP_X86
+
+// ******************************************************************************
+// SSE2, every x86-64 cpu has it
+
+__attribute__((target("sse2")))
+static float dot1_sse2(const float *x, const float *h, int32_t n) {
+	__m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps();
+	int32_t i = 0;
+	float s;
+
+	for (; i + 8 <= n; i += 8)
+	{
+		a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(h + i)));
+		a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(x + i + 4), _mm_loadu_ps(h + i + 4)));
+	}
+	for (; i + 4 <= n; i += 4)
+		a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(h + i)));
+
+	a0 = _mm_add_ps(a0, a1);
+	a0 = _mm_add_ps(a0, _mm_movehl_ps(a0, a0));
+	a0 = _mm_add_ss(a0, _mm_shuffle_ps(a0, a0, 1));
+	s = _mm_cvtss_f32(a0);
+
+	for (; i < n; i++)
+		s += x[i] * h[i];
+
+	return s;
+}
+
+__attribute__((target("sse2")))
+static void dot2_sse2(const float *x, const float *h, int32_t n, float *out) {
+	__m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps();
+	int32_t i = 0;
+	float lr[4];
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 hv = _mm_loadu_ps(h + i);
+		a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(x + i * 2), _mm_unpacklo_ps(hv, hv)));
+		a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(x + i * 2 + 4), _mm_unpackhi_ps(hv, hv)));
+	}
+
+	a0 = _mm_add_ps(a0, a1);
+	a0 = _mm_add_ps(a0, _mm_movehl_ps(a0, a0));
+	_mm_storeu_ps(lr, a0);
+
+	for (; i < n; i++)
+	{
+		lr[0] += x[i * 2] * h[i];
+		lr[1] += x[i * 2 + 1] * h[i];
+	}
+
+	out[0] += lr[0];
+	out[1] += lr[1];
+}
+
+// pmaddwd, eight 16 bit products summed in pairs into four 32 bit lanes
+__attribute__((target("sse2")))
+static int32_t dot1i_sse2(const int16_t *x, const int16_t *h, int32_t n) {
+	__m128i a0 = _mm_setzero_si128(), a1 = _mm_setzero_si128();
+	int32_t i = 0;
+	int32_t s;
+
+	for (; i + 16 <= n; i += 16)
+	{
+		a0 = _mm_add_epi32(a0, _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(x + i)), _mm_loadu_si128((const __m128i*)(h + i))));
+		a1 = _mm_add_epi32(a1, _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(x + i + 8)), _mm_loadu_si128((const __m128i*)(h + i + 8))));
+	}
+	for (; i + 8 <= n; i += 8)
+		a0 = _mm_add_epi32(a0, _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(x + i)), _mm_loadu_si128((const __m128i*)(h + i))));
+
+	a0 = _mm_add_epi32(a0, a1);
+	a0 = _mm_add_epi32(a0, _mm_shuffle_epi32(a0, _MM_SHUFFLE(1, 0, 3, 2)));
+	a0 = _mm_add_epi32(a0, _mm_shuffle_epi32(a0, _MM_SHUFFLE(2, 3, 0, 1)));
+	s = _mm_cvtsi128_si32(a0);
+
+	for (; i < n; i++)
+		s += x[i] * h[i];
+
+	return s;
+}
+
+// frames L0 R0 L1 R1 are reordered to L0 L1 R0 R1 against taps h0 h1 h0 h1, so
+// pmaddwd pairs each channel with itself
+__attribute__((target("sse2")))
+static void dot2i_sse2(const int16_t *x, const int16_t *h, int32_t n, int32_t *out) {
+	__m128i a0 = _mm_setzero_si128(), a1 = _mm_setzero_si128();
+	int32_t i = 0;
+	int32_t l, r;
+
+	for (; i + 8 <= n; i += 8)
+	{
+		__m128i v0 = _mm_loadu_si128((const __m128i*)(x + i * 2));
+		__m128i v1 = _mm_loadu_si128((const __m128i*)(x + i * 2 + 8));
+		__m128i t = _mm_loadu_si128((const __m128i*)(h + i));
+
+		v0 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v0, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+		v1 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v1, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+		a0 = _mm_add_epi32(a0, _mm_madd_epi16(v0, _mm_unpacklo_epi32(t, t)));
+		a1 = _mm_add_epi32(a1, _mm_madd_epi16(v1, _mm_unpackhi_epi32(t, t)));
+	}
+
+	a0 = _mm_add_epi32(a0, a1);
+	a0 = _mm_add_epi32(a0, _mm_shuffle_epi32(a0, _MM_SHUFFLE(1, 0, 3, 2)));
+	l = _mm_cvtsi128_si32(a0);
+	r = _mm_cvtsi128_si32(_mm_shuffle_epi32(a0, 1));
+
+	for (; i < n; i++)
+	{
+		l += x[i * 2] * h[i];
+		r += x[i * 2 + 1] * h[i];
+	}
+
+	out[0] = l;
+	out[1] = r;
+}
+
+__attribute__((target("sse2")))
+static void lerp_sse2(float *h, const float *value, const float *delta, float interp, int32_t n, int32_t reverse) {
+	__m128 t = _mm_set1_ps(interp);
+	int32_t i = 0;
+
+	if (reverse) {
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128 r = _mm_add_ps(_mm_loadu_ps(value + i), _mm_mul_ps(_mm_loadu_ps(delta + i), t));
+			_mm_storeu_ps(h + n - 4 - i, _mm_shuffle_ps(r, r, _MM_SHUFFLE(0, 1, 2, 3)));
+		}
+		for (; i < n; i++)
+			h[n - 1 - i] = value[i] + delta[i] * interp;
+	} else {
+		for (; i + 4 <= n; i += 4)
+			_mm_storeu_ps(h + i, _mm_add_ps(_mm_loadu_ps(value + i), _mm_mul_ps(_mm_loadu_ps(delta + i), t)));
+		for (; i < n; i++)
+			h[i] = value[i] + delta[i] * interp;
+	}
+}
+
+__attribute__((target("sse2")))
+static void butterfly_sse2(float *sr, float *si, float *dr, float *di, const float *ar, const float *ai,
+						const float *br, const float *bi, float cr, float ci, int32_t n) {
+	__m128 c = _mm_set1_ps(cr), s = _mm_set1_ps(ci);
+	int32_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 xr = _mm_loadu_ps(ar + i), xi = _mm_loadu_ps(ai + i);
+		__m128 yr = _mm_loadu_ps(br + i), yi = _mm_loadu_ps(bi + i);
+		__m128 tr = _mm_sub_ps(xr, yr), ti = _mm_sub_ps(xi, yi);
+		_mm_storeu_ps(sr + i, _mm_add_ps(xr, yr));
+		_mm_storeu_ps(si + i, _mm_add_ps(xi, yi));
+		_mm_storeu_ps(dr + i, _mm_sub_ps(_mm_mul_ps(tr, c), _mm_mul_ps(ti, s)));
+		_mm_storeu_ps(di + i, _mm_add_ps(_mm_mul_ps(tr, s), _mm_mul_ps(ti, c)));
+	}
+
+	for (; i < n; i++)
+	{
+		float tr = ar[i] - br[i], ti = ai[i] - bi[i];
+
+		sr[i] = ar[i] + br[i];
+		si[i] = ai[i] + bi[i];
+		dr[i] = tr * cr - ti * ci;
+		di[i] = tr * ci + ti * cr;
+	}
+}
+
+__attribute__((target("sse2")))
+static void cmac_sse2(float *yr, float *yi, const float *xr, const float *xi, const float *hr, const float *hi, int32_t n) {
+	int32_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 ar = _mm_loadu_ps(xr + i), ai = _mm_loadu_ps(xi + i);
+		__m128 br = _mm_loadu_ps(hr + i), bi = _mm_loadu_ps(hi + i);
+		_mm_storeu_ps(yr + i, _mm_add_ps(_mm_loadu_ps(yr + i), _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi))));
+		_mm_storeu_ps(yi + i, _mm_add_ps(_mm_loadu_ps(yi + i), _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br))));
+	}
+
+	for (; i < n; i++)
+	{
+		yr[i] += xr[i] * hr[i] - xi[i] * hi[i];
+		yi[i] += xr[i] * hi[i] + xi[i] * hr[i];
+	}
+}
+
+// packed v >= 1 converts to 0x80000000, flipping those lanes gives INT32_MAX, v <= -1
+// already is INT32_MIN, as store_packed()
+__attribute__((target("sse2")))
+static inline __m128i pack_sse2(__m128 v) {
+	const __m128 one = _mm_set1_ps(1.0f), scale = _mm_set1_ps(2147483648.0f);
+
+	return _mm_xor_si128(_mm_cvttps_epi32(_mm_mul_ps(v, scale)), _mm_castps_si128(_mm_cmpge_ps(v, one)));
+}
+
+// no pshufb before SSSE3, so 24 bit samples are moved into their lanes with whole
+// register byte shifts, one per lane
+__attribute__((target("sse2")))
+static void load_sse2(float *out, const void *in, int64_t n, int32_t format) {
+	const uint8_t *b = (const uint8_t*)in;
+	const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+	const __m128i zero = _mm_setzero_si128();
+	int64_t i = 0;
+
+	switch (format) {
+		case SWS_DSP_U8: {
+			const __m128 div = _mm_set1_ps(127.0f), one = _mm_set1_ps(1.0f);
+
+			for (; i + 8 <= n; i += 8)
+			{
+				__m128i x = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(b + i)), zero);
+
+				_mm_storeu_ps(out + i, _mm_sub_ps(_mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(x, zero)), div), one));
+				_mm_storeu_ps(out + i + 4, _mm_sub_ps(_mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(x, zero)), div), one));
+			}
+			break;
+		}
+		case SWS_DSP_S16: {
+			const __m128 div = _mm_set1_ps(1.0f / 32768.0f);
+
+			for (; i + 8 <= n; i += 8)
+			{
+				__m128i x = _mm_loadu_si128((const __m128i*)((const int16_t*)in + i));
+
+				_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16)), div));
+				_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16)), div));
+			}
+			break;
+		}
+		case SWS_DSP_S24: {
+			const __m128i m0 = _mm_set_epi32(0, 0, 0, -256), m1 = _mm_set_epi32(0, 0, -256, 0);
+			const __m128i m2 = _mm_set_epi32(0, -256, 0, 0), m3 = _mm_set_epi32(-256, 0, 0, 0);
+
+			// each load reads 4 bytes past its 4 samples
+			for (; i + 6 <= n; i += 4)
+			{
+				__m128i x = _mm_loadu_si128((const __m128i*)(b + i * 3));
+				__m128i v = _mm_or_si128(_mm_and_si128(_mm_slli_si128(x, 1), m0), _mm_and_si128(_mm_slli_si128(x, 2), m1));
+
+				v = _mm_or_si128(v, _mm_or_si128(_mm_and_si128(_mm_slli_si128(x, 3), m2), _mm_and_si128(_mm_slli_si128(x, 4), m3)));
+				_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+			}
+			break;
+		}
+		case SWS_DSP_S32:
+			for (; i + 4 <= n; i += 4)
+				_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(b + i * 4))), scale));
+			break;
+		default:
+			memcpy(out, in, n * sizeof(float));
+			return;
+	}
+
+	load_scalar(out + i, b + i * FORMAT_BYTES(format), n - i, format);
+}
+
+__attribute__((target("sse2")))
+static void store_sse2(void *out, const float *in, int64_t n, int32_t format) {
+	uint8_t *b = (uint8_t*)out;
+	int64_t i = 0;
+
+	switch (format) {
+		case SWS_DSP_U8: {
+			const __m128 one = _mm_set1_ps(1.0f), mul = _mm_set1_ps(127.5f);
+			const __m128 lo = _mm_setzero_ps(), hi = _mm_set1_ps(255.0f);
+
+			for (; i + 8 <= n; i += 8)
+			{
+				__m128 v0 = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(in + i), one), mul);
+				__m128 v1 = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(in + i + 4), one), mul);
+				__m128i x = _mm_packs_epi32(_mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(v0, lo), hi)),
+											_mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(v1, lo), hi)));
+
+				_mm_storel_epi64((__m128i*)(b + i), _mm_packus_epi16(x, x));
+			}
+			break;
+		}
+		case SWS_DSP_S16: {
+			const __m128 mul = _mm_set1_ps(32767.0f);
+			const __m128 lo = _mm_set1_ps(-32768.0f), hi = _mm_set1_ps(32767.0f);
+
+			for (; i + 8 <= n; i += 8)
+			{
+				__m128 v0 = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i), mul), lo), hi);
+				__m128 v1 = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), mul), lo), hi);
+
+				_mm_storeu_si128((__m128i*)((int16_t*)out + i), _mm_packs_epi32(_mm_cvttps_epi32(v0), _mm_cvttps_epi32(v1)));
+			}
+			break;
+		}
+		case SWS_DSP_S24: {
+			const __m128i m0 = _mm_set_epi32(0, 0, 0, -256), m1 = _mm_set_epi32(0, 0, -256, 0);
+			const __m128i m2 = _mm_set_epi32(0, -256, 0, 0), m3 = _mm_set_epi32(-256, 0, 0, 0);
+
+			for (; i + 4 <= n; i += 4)
+			{
+				__m128i x = pack_sse2(_mm_loadu_ps(in + i));
+				__m128i v = _mm_or_si128(_mm_srli_si128(_mm_and_si128(x, m0), 1), _mm_srli_si128(_mm_and_si128(x, m1), 2));
+				int32_t top;
+
+				v = _mm_or_si128(v, _mm_or_si128(_mm_srli_si128(_mm_and_si128(x, m2), 3), _mm_srli_si128(_mm_and_si128(x, m3), 4)));
+				_mm_storel_epi64((__m128i*)(b + i * 3), v);
+				top = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+				memcpy(b + i * 3 + 8, &top, 4);
+			}
+			break;
+		}
+		case SWS_DSP_S32:
+			for (; i + 4 <= n; i += 4)
+				_mm_storeu_si128((__m128i*)(b + i * 4), pack_sse2(_mm_loadu_ps(in + i)));
+			break;
+		default:
+			memcpy(out, in, n * sizeof(float));
+			return;
+	}
+
+	store_scalar(b + i * FORMAT_BYTES(format), in + i, n - i, format);
+}
+
+// no fp16 conversion before F16C, which comes with the AVX2 level
+static const swsDsp dspSse2 = { SWS_DSP_SSE2, "sse2", dot1_sse2, dot2_sse2, dot1i_sse2, dot2i_sse2,
+									lerp_sse2, lerp16_scalar, butterfly_sse2, cmac_sse2, load_sse2, store_sse2 };
+
+// ******************************************************************************
+// AVX2 + FMA
+
+__attribute__((target("avx2,fma")))
+static inline float hsum_avx(__m256 v) {
+	__m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+	return _mm_cvtss_f32(s);
+}
+
+__attribute__((target("avx2,fma")))
+static float dot1_avx2(const float *x, const float *h, int32_t n) {
+	__m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+	__m256 a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+	int32_t i = 0;
+	float s;
+
+	for (; i + 32 <= n; i += 32)
+	{
+		a0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(h + i), a0);
+		a1 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i + 8), _mm256_loadu_ps(h + i + 8), a1);
+		a2 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i + 16), _mm256_loadu_ps(h + i + 16), a2);
+		a3 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i + 24), _mm256_loadu_ps(h + i + 24), a3);
+	}
+	for (; i + 8 <= n; i += 8)
+		a0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(h + i), a0);
+
+	s = hsum_avx(_mm256_add_ps(_mm256_add_ps(a0, a1), _mm256_add_ps(a2, a3)));
+
+	for (; i < n; i++)
+		s += x[i] * h[i];
+
+	return s;
+}
+
+__attribute__((target("avx2,fma")))
+static void dot2_avx2(const float *x, const float *h, int32_t n, float *out) {
+	const __m256i lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+	const __m256i hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+	__m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+	__m128 s;
+	int32_t i = 0;
+	float lr[4];
+
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256 hv = _mm256_loadu_ps(h + i);
+		a0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i * 2), _mm256_permutevar8x32_ps(hv, lo), a0);
+		a1 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i * 2 + 8), _mm256_permutevar8x32_ps(hv, hi), a1);
+	}
+
+	// lanes alternate left / right
+	a0 = _mm256_add_ps(a0, a1);
+	s = _mm_add_ps(_mm256_castps256_ps128(a0), _mm256_extractf128_ps(a0, 1));
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	_mm_storeu_ps(lr, s);
+
+	for (; i < n; i++)
+	{
+		lr[0] += x[i * 2] * h[i];
+		lr[1] += x[i * 2 + 1] * h[i];
+	}
+
+	out[0] += lr[0];
+	out[1] += lr[1];
+}
+
+__attribute__((target("avx2,fma")))
+static int32_t dot1i_avx2(const int16_t *x, const int16_t *h, int32_t n) {
+	__m256i a0 = _mm256_setzero_si256(), a1 = _mm256_setzero_si256();
+	__m128i a;
+	int32_t i = 0;
+	int32_t s;
+
+	for (; i + 32 <= n; i += 32)
+	{
+		a0 = _mm256_add_epi32(a0, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)(x + i)), _mm256_loadu_si256((const __m256i*)(h + i))));
+		a1 = _mm256_add_epi32(a1, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)(x + i + 16)), _mm256_loadu_si256((const __m256i*)(h + i + 16))));
+	}
+	for (; i + 16 <= n; i += 16)
+		a0 = _mm256_add_epi32(a0, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)(x + i)), _mm256_loadu_si256((const __m256i*)(h + i))));
+
+	a0 = _mm256_add_epi32(a0, a1);
+	a = _mm_add_epi32(_mm256_castsi256_si128(a0), _mm256_extracti128_si256(a0, 1));
+	a = _mm_add_epi32(a, _mm_shuffle_epi32(a, _MM_SHUFFLE(1, 0, 3, 2)));
+	a = _mm_add_epi32(a, _mm_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1)));
+	s = _mm_cvtsi128_si32(a);
+
+	for (; i < n; i++)
+		s += x[i] * h[i];
+
+	return s;
+}
+
+__attribute__((target("avx2,fma")))
+static void dot2i_avx2(const int16_t *x, const int16_t *h, int32_t n, int32_t *out) {
+	const __m256i pairs = _mm256_setr_epi8(0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15,
+										0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15);
+	const __m256i dup = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+	__m256i a0 = _mm256_setzero_si256(), a1 = _mm256_setzero_si256();
+	int32_t i = 0;
+	__m128i a;
+	int32_t l, r;
+
+	for (; i + 16 <= n; i += 16)
+	{
+		__m256i t0 = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(h + i)));
+		__m256i t1 = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(h + i + 8)));
+
+		a0 = _mm256_add_epi32(a0, _mm256_madd_epi16(_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(x + i * 2)), pairs),
+												_mm256_permutevar8x32_epi32(t0, dup)));
+		a1 = _mm256_add_epi32(a1, _mm256_madd_epi16(_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(x + i * 2 + 16)), pairs),
+												_mm256_permutevar8x32_epi32(t1, dup)));
+	}
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256i t0 = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(h + i)));
+
+		a0 = _mm256_add_epi32(a0, _mm256_madd_epi16(_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(x + i * 2)), pairs),
+												_mm256_permutevar8x32_epi32(t0, dup)));
+	}
+
+	a0 = _mm256_add_epi32(a0, a1);
+	a = _mm_add_epi32(_mm256_castsi256_si128(a0), _mm256_extracti128_si256(a0, 1));
+	a = _mm_add_epi32(a, _mm_shuffle_epi32(a, _MM_SHUFFLE(1, 0, 3, 2)));
+	l = _mm_cvtsi128_si32(a);
+	r = _mm_cvtsi128_si32(_mm_shuffle_epi32(a, 1));
+
+	for (; i < n; i++)
+	{
+		l += x[i * 2] * h[i];
+		r += x[i * 2 + 1] * h[i];
+	}
+
+	out[0] = l;
+	out[1] = r;
+}
+
+__attribute__((target("avx2,fma")))
+static void lerp_avx2(float *h, const float *value, const float *delta, float interp, int32_t n, int32_t reverse) {
+	const __m256i back = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+	__m256 t = _mm256_set1_ps(interp);
+	int32_t i = 0;
+
+	if (reverse) {
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256 r = _mm256_fmadd_ps(_mm256_loadu_ps(delta + i), t, _mm256_loadu_ps(value + i));
+			_mm256_storeu_ps(h + n - 8 - i, _mm256_permutevar8x32_ps(r, back));
+		}
+		for (; i < n; i++)
+			h[n - 1 - i] = value[i] + delta[i] * interp;
+	} else {
+		for (; i + 8 <= n; i += 8)
+			_mm256_storeu_ps(h + i, _mm256_fmadd_ps(_mm256_loadu_ps(delta + i), t, _mm256_loadu_ps(value + i)));
+		for (; i < n; i++)
+			h[i] = value[i] + delta[i] * interp;
+	}
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static void lerp16_avx2(float *h, const uint16_t *value, const uint16_t *delta, float interp, int32_t n, int32_t reverse) {
+	const __m256i back = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+	__m256 t = _mm256_set1_ps(interp);
+	int32_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256 v = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(value + i)));
+		__m256 d = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(delta + i)));
+		__m256 r = _mm256_fmadd_ps(d, t, v);
+
+		if (reverse)
+			_mm256_storeu_ps(h + n - 8 - i, _mm256_permutevar8x32_ps(r, back));
+		else
+			_mm256_storeu_ps(h + i, r);
+	}
+	for (; i < n; i++)
+	{
+		float r = half_to_float(value[i]) + half_to_float(delta[i]) * interp;
+
+		h[reverse ? n - 1 - i : i] = r;
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static void butterfly_avx2(float *sr, float *si, float *dr, float *di, const float *ar, const float *ai,
+						const float *br, const float *bi, float cr, float ci, int32_t n) {
+	__m256 c = _mm256_set1_ps(cr), s = _mm256_set1_ps(ci);
+	int32_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256 xr = _mm256_loadu_ps(ar + i), xi = _mm256_loadu_ps(ai + i);
+		__m256 yr = _mm256_loadu_ps(br + i), yi = _mm256_loadu_ps(bi + i);
+		__m256 tr = _mm256_sub_ps(xr, yr), ti = _mm256_sub_ps(xi, yi);
+		_mm256_storeu_ps(sr + i, _mm256_add_ps(xr, yr));
+		_mm256_storeu_ps(si + i, _mm256_add_ps(xi, yi));
+		_mm256_storeu_ps(dr + i, _mm256_fmsub_ps(tr, c, _mm256_mul_ps(ti, s)));
+		_mm256_storeu_ps(di + i, _mm256_fmadd_ps(tr, s, _mm256_mul_ps(ti, c)));
+	}
+
+	for (; i < n; i++)
+	{
+		float tr = ar[i] - br[i], ti = ai[i] - bi[i];
+
+		sr[i] = ar[i] + br[i];
+		si[i] = ai[i] + bi[i];
+		dr[i] = tr * cr - ti * ci;
+		di[i] = tr * ci + ti * cr;
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static void cmac_avx2(float *yr, float *yi, const float *xr, const float *xi, const float *hr, const float *hi, int32_t n) {
+	int32_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256 ar = _mm256_loadu_ps(xr + i), ai = _mm256_loadu_ps(xi + i);
+		__m256 br = _mm256_loadu_ps(hr + i), bi = _mm256_loadu_ps(hi + i);
+		_mm256_storeu_ps(yr + i, _mm256_fnmadd_ps(ai, bi, _mm256_fmadd_ps(ar, br, _mm256_loadu_ps(yr + i))));
+		_mm256_storeu_ps(yi + i, _mm256_fmadd_ps(ai, br, _mm256_fmadd_ps(ar, bi, _mm256_loadu_ps(yi + i))));
+	}
+
+	for (; i < n; i++)
+	{
+		yr[i] += xr[i] * hr[i] - xi[i] * hi[i];
+		yi[i] += xr[i] * hi[i] + xi[i] * hr[i];
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256i pack_avx2(__m256 v) {
+	const __m256 one = _mm256_set1_ps(1.0f), scale = _mm256_set1_ps(2147483648.0f);
+
+	return _mm256_xor_si256(_mm256_cvttps_epi32(_mm256_mul_ps(v, scale)), _mm256_castps_si256(_mm256_cmp_ps(v, one, _CMP_GE_OQ)));
+}
+
+// 24 bit: 8 samples are 24 bytes, the dwords holding each half are spread to their
+// own 128 bit lane and pshufb puts each sample in the top 3 bytes of its dword
+__attribute__((target("avx2,fma")))
+static void load_avx2(float *out, const void *in, int64_t n, int32_t format) {
+	const uint8_t *b = (const uint8_t*)in;
+	const __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+	int64_t i = 0;
+
+	switch (format) {
+		case SWS_DSP_U8: {
+			const __m256 div = _mm256_set1_ps(127.0f), one = _mm256_set1_ps(1.0f);
+
+			for (; i + 8 <= n; i += 8)
+			{
+				__m256 v = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(b + i))));
+
+				_mm256_storeu_ps(out + i, _mm256_sub_ps(_mm256_div_ps(v, div), one));
+			}
+			break;
+		}
+		case SWS_DSP_S16: {
+			const __m256 div = _mm256_set1_ps(1.0f / 32768.0f);
+
+			for (; i + 8 <= n; i += 8)
+			{
+				__m256i x = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)((const int16_t*)in + i)));
+
+				_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), div));
+			}
+			break;
+		}
+		case SWS_DSP_S24: {
+			const __m256i spread = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+			const __m256i shuf = _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+												-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+
+			// each load reads 8 bytes past its 8 samples
+			for (; i + 11 <= n; i += 8)
+			{
+				__m256i x = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(b + i * 3)), spread);
+
+				_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_shuffle_epi8(x, shuf)), scale));
+			}
+			break;
+		}
+		case SWS_DSP_S32:
+			for (; i + 8 <= n; i += 8)
+				_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(b + i * 4))), scale));
+			break;
+		default:
+			memcpy(out, in, n * sizeof(float));
+			return;
+	}
+
+	load_scalar(out + i, b + i * FORMAT_BYTES(format), n - i, format);
+}
+
+__attribute__((target("avx2,fma")))
+static void store_avx2(void *out, const float *in, int64_t n, int32_t format) {
+	uint8_t *b = (uint8_t*)out;
+	int64_t i = 0;
+
+	switch (format) {
+		case SWS_DSP_U8: {
+			const __m256 one = _mm256_set1_ps(1.0f), mul = _mm256_set1_ps(127.5f);
+			const __m256 lo = _mm256_setzero_ps(), hi = _mm256_set1_ps(255.0f);
+
+			for (; i + 8 <= n; i += 8)
+			{
+				__m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(in + i), one), mul);
+				__m256i x = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(v, lo), hi));
+				__m128i w = _mm_packs_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+
+				_mm_storel_epi64((__m128i*)(b + i), _mm_packus_epi16(w, w));
+			}
+			break;
+		}
+		case SWS_DSP_S16: {
+			const __m256 mul = _mm256_set1_ps(32767.0f);
+			const __m256 lo = _mm256_set1_ps(-32768.0f), hi = _mm256_set1_ps(32767.0f);
+
+			for (; i + 8 <= n; i += 8)
+			{
+				__m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i), mul), lo), hi);
+				__m256i x = _mm256_cvttps_epi32(v);
+
+				_mm_storeu_si128((__m128i*)((int16_t*)out + i), _mm_packs_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1)));
+			}
+			break;
+		}
+		case SWS_DSP_S24: {
+			const __m256i shuf = _mm256_setr_epi8(1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1,
+												1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1);
+			const __m256i gather = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+			const __m256i six = _mm256_setr_epi32(-1, -1, -1, -1, -1, -1, 0, 0);
+
+			for (; i + 8 <= n; i += 8)
+			{
+				__m256i x = _mm256_shuffle_epi8(pack_avx2(_mm256_loadu_ps(in + i)), shuf);
+
+				_mm256_maskstore_epi32((int*)(b + i * 3), six, _mm256_permutevar8x32_epi32(x, gather));
+			}
+			break;
+		}
+		case SWS_DSP_S32:
+			for (; i + 8 <= n; i += 8)
+				_mm256_storeu_si256((__m256i*)(b + i * 4), pack_avx2(_mm256_loadu_ps(in + i)));
+			break;
+		default:
+			memcpy(out, in, n * sizeof(float));
+			return;
+	}
+
+	store_scalar(b + i * FORMAT_BYTES(format), in + i, n - i, format);
+}
+
+static const swsDsp dspAvx2 = { SWS_DSP_AVX2, "avx2", dot1_avx2, dot2_avx2, dot1i_avx2, dot2i_avx2,
+									lerp_avx2, lerp16_avx2, butterfly_avx2, cmac_avx2, load_avx2, store_avx2 };
+
+// ******************************************************************************
+// AVX-512
+
+__attribute__((target("avx512f")))
+static float dot1_avx512(const float *x, const float *h, int32_t n) {
+	__m512 a0 = _mm512_setzero_ps(), a1 = _mm512_setzero_ps();
+	__m512 a2 = _mm512_setzero_ps(), a3 = _mm512_setzero_ps();
+	int32_t i = 0;
+
+	for (; i + 64 <= n; i += 64)
+	{
+		a0 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(h + i), a0);
+		a1 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i + 16), _mm512_loadu_ps(h + i + 16), a1);
+		a2 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i + 32), _mm512_loadu_ps(h + i + 32), a2);
+		a3 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i + 48), _mm512_loadu_ps(h + i + 48), a3);
+	}
+	for (; i + 16 <= n; i += 16)
+		a0 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(h + i), a0);
+
+	// masked loads take care of the tail
+	if (i < n) {
+		__mmask16 m = (__mmask16)((1u << (n - i)) - 1);
+		a1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, x + i), _mm512_maskz_loadu_ps(m, h + i), a1);
+	}
+
+	return _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(a0, a1), _mm512_add_ps(a2, a3)));
+}
+
+__attribute__((target("avx512f")))
+static void dot2_avx512(const float *x, const float *h, int32_t n, float *out) {
+	const __m512i lo = _mm512_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7);
+	const __m512i hi = _mm512_setr_epi32(8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15);
+	__m512 a0 = _mm512_setzero_ps(), a1 = _mm512_setzero_ps();
+	__m256 a;
+	__m128 s;
+	int32_t i = 0;
+	float lr[4];
+
+	for (; i + 16 <= n; i += 16)
+	{
+		__m512 hv = _mm512_loadu_ps(h + i);
+		a0 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i * 2), _mm512_permutexvar_ps(lo, hv), a0);
+		a1 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i * 2 + 16), _mm512_permutexvar_ps(hi, hv), a1);
+	}
+
+	// lanes alternate left / right
+	a0 = _mm512_add_ps(a0, a1);
+	a = _mm256_add_ps(_mm512_castps512_ps256(a0), _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(a0), 1)));
+	s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	_mm_storeu_ps(lr, s);
+
+	for (; i < n; i++)
+	{
+		lr[0] += x[i * 2] * h[i];
+		lr[1] += x[i * 2 + 1] * h[i];
+	}
+
+	out[0] += lr[0];
+	out[1] += lr[1];
+}
+
+// 16 bit multiplies are AVX512BW, which every AVX-512 desktop and server cpu has
+__attribute__((target("avx512f,avx512bw")))
+static int32_t dot1i_avx512(const int16_t *x, const int16_t *h, int32_t n) {
+	__m512i a0 = _mm512_setzero_si512(), a1 = _mm512_setzero_si512();
+	int32_t i = 0;
+	int32_t s;
+
+	for (; i + 64 <= n; i += 64)
+	{
+		a0 = _mm512_add_epi32(a0, _mm512_madd_epi16(_mm512_loadu_si512(x + i), _mm512_loadu_si512(h + i)));
+		a1 = _mm512_add_epi32(a1, _mm512_madd_epi16(_mm512_loadu_si512(x + i + 32), _mm512_loadu_si512(h + i + 32)));
+	}
+	for (; i + 32 <= n; i += 32)
+		a0 = _mm512_add_epi32(a0, _mm512_madd_epi16(_mm512_loadu_si512(x + i), _mm512_loadu_si512(h + i)));
+	// no masked loads for the tail, the newest frames were stored just before the
+	// call and a masked load waits for them to retire instead of forwarding
+	if (i + 16 <= n) {
+		a0 = _mm512_add_epi32(a0, _mm512_zextsi256_si512(_mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)(x + i)),
+														_mm256_loadu_si256((const __m256i*)(h + i)))));
+		i += 16;
+	}
+
+	s = _mm512_reduce_add_epi32(_mm512_add_epi32(a0, a1));
+
+	for (; i < n; i++)
+		s += x[i] * h[i];
+
+	return s;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void dot2i_avx512(const int16_t *x, const int16_t *h, int32_t n, int32_t *out) {
+	const __m512i pairs = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15));
+	const __m512i dup = _mm512_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7);
+	__m512i a0 = _mm512_setzero_si512(), a1 = _mm512_setzero_si512();
+	__m256i a;
+	int32_t i = 0;
+	__m128i s;
+	int32_t l, r;
+
+	for (; i + 32 <= n; i += 32)
+	{
+		__m512i t0 = _mm512_castsi256_si512(_mm256_loadu_si256((const __m256i*)(h + i)));
+		__m512i t1 = _mm512_castsi256_si512(_mm256_loadu_si256((const __m256i*)(h + i + 16)));
+
+		a0 = _mm512_add_epi32(a0, _mm512_madd_epi16(_mm512_shuffle_epi8(_mm512_loadu_si512(x + i * 2), pairs),
+												_mm512_permutexvar_epi32(dup, t0)));
+		a1 = _mm512_add_epi32(a1, _mm512_madd_epi16(_mm512_shuffle_epi8(_mm512_loadu_si512(x + i * 2 + 32), pairs),
+												_mm512_permutexvar_epi32(dup, t1)));
+	}
+	// plain loads and a scalar tail, as dot1i
+	if (i + 16 <= n) {
+		__m512i t0 = _mm512_castsi256_si512(_mm256_loadu_si256((const __m256i*)(h + i)));
+
+		a0 = _mm512_add_epi32(a0, _mm512_madd_epi16(_mm512_shuffle_epi8(_mm512_loadu_si512(x + i * 2), pairs),
+												_mm512_permutexvar_epi32(dup, t0)));
+		i += 16;
+	}
+
+	a0 = _mm512_add_epi32(a0, a1);
+	a = _mm256_add_epi32(_mm512_castsi512_si256(a0), _mm512_extracti64x4_epi64(a0, 1));
+	s = _mm_add_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+	l = _mm_cvtsi128_si32(s);
+	r = _mm_cvtsi128_si32(_mm_shuffle_epi32(s, 1));
+
+	for (; i < n; i++)
+	{
+		l += x[i * 2] * h[i];
+		r += x[i * 2 + 1] * h[i];
+	}
+
+	out[0] = l;
+	out[1] = r;
+}
+
+__attribute__((target("avx512f")))
+static void lerp_avx512(float *h, const float *value, const float *delta, float interp, int32_t n, int32_t reverse) {
+	const __m512i back = _mm512_setr_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	__m512 t = _mm512_set1_ps(interp);
+	int32_t i = 0;
+
+	if (reverse) {
+		for (; i + 16 <= n; i += 16)
+		{
+			__m512 r = _mm512_fmadd_ps(_mm512_loadu_ps(delta + i), t, _mm512_loadu_ps(value + i));
+			_mm512_storeu_ps(h + n - 16 - i, _mm512_permutexvar_ps(back, r));
+		}
+		for (; i < n; i++)
+			h[n - 1 - i] = value[i] + delta[i] * interp;
+	} else {
+		for (; i + 16 <= n; i += 16)
+			_mm512_storeu_ps(h + i, _mm512_fmadd_ps(_mm512_loadu_ps(delta + i), t, _mm512_loadu_ps(value + i)));
+		for (; i < n; i++)
+			h[i] = value[i] + delta[i] * interp;
+	}
+}
+
+__attribute__((target("avx512f")))
+static void lerp16_avx512(float *h, const uint16_t *value, const uint16_t *delta, float interp, int32_t n, int32_t reverse) {
+	const __m512i back = _mm512_setr_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	__m512 t = _mm512_set1_ps(interp);
+	int32_t i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{
+		__m512 v = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(value + i)));
+		__m512 d = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(delta + i)));
+		__m512 r = _mm512_fmadd_ps(d, t, v);
+
+		if (reverse)
+			_mm512_storeu_ps(h + n - 16 - i, _mm512_permutexvar_ps(back, r));
+		else
+			_mm512_storeu_ps(h + i, r);
+	}
+	for (; i < n; i++)
+	{
+		float r = half_to_float(value[i]) + half_to_float(delta[i]) * interp;
+
+		h[reverse ? n - 1 - i : i] = r;
+	}
+}
+
+__attribute__((target("avx512f")))
+static void butterfly_avx512(float *sr, float *si, float *dr, float *di, const float *ar, const float *ai,
+						const float *br, const float *bi, float cr, float ci, int32_t n) {
+	__m512 c = _mm512_set1_ps(cr), s = _mm512_set1_ps(ci);
+	int32_t i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{
+		__m512 xr = _mm512_loadu_ps(ar + i), xi = _mm512_loadu_ps(ai + i);
+		__m512 yr = _mm512_loadu_ps(br + i), yi = _mm512_loadu_ps(bi + i);
+		__m512 tr = _mm512_sub_ps(xr, yr), ti = _mm512_sub_ps(xi, yi);
+		_mm512_storeu_ps(sr + i, _mm512_add_ps(xr, yr));
+		_mm512_storeu_ps(si + i, _mm512_add_ps(xi, yi));
+		_mm512_storeu_ps(dr + i, _mm512_fmsub_ps(tr, c, _mm512_mul_ps(ti, s)));
+		_mm512_storeu_ps(di + i, _mm512_fmadd_ps(tr, s, _mm512_mul_ps(ti, c)));
+	}
+
+	// masked loads and stores take care of the tail
+	if (i < n) {
+		__mmask16 m = (__mmask16)((1u << (n - i)) - 1);
+		__m512 xr = _mm512_maskz_loadu_ps(m, ar + i), xi = _mm512_maskz_loadu_ps(m, ai + i);
+		__m512 yr = _mm512_maskz_loadu_ps(m, br + i), yi = _mm512_maskz_loadu_ps(m, bi + i);
+		__m512 tr = _mm512_sub_ps(xr, yr), ti = _mm512_sub_ps(xi, yi);
+		_mm512_mask_storeu_ps(sr + i, m, _mm512_add_ps(xr, yr));
+		_mm512_mask_storeu_ps(si + i, m, _mm512_add_ps(xi, yi));
+		_mm512_mask_storeu_ps(dr + i, m, _mm512_fmsub_ps(tr, c, _mm512_mul_ps(ti, s)));
+		_mm512_mask_storeu_ps(di + i, m, _mm512_fmadd_ps(tr, s, _mm512_mul_ps(ti, c)));
+	}
+}
+
+__attribute__((target("avx512f")))
+static void cmac_avx512(float *yr, float *yi, const float *xr, const float *xi, const float *hr, const float *hi, int32_t n) {
+	int32_t i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{
+		__m512 ar = _mm512_loadu_ps(xr + i), ai = _mm512_loadu_ps(xi + i);
+		__m512 br = _mm512_loadu_ps(hr + i), bi = _mm512_loadu_ps(hi + i);
+		_mm512_storeu_ps(yr + i, _mm512_fnmadd_ps(ai, bi, _mm512_fmadd_ps(ar, br, _mm512_loadu_ps(yr + i))));
+		_mm512_storeu_ps(yi + i, _mm512_fmadd_ps(ai, br, _mm512_fmadd_ps(ar, bi, _mm512_loadu_ps(yi + i))));
+	}
+
+	if (i < n) {
+		__mmask16 m = (__mmask16)((1u << (n - i)) - 1);
+		__m512 ar = _mm512_maskz_loadu_ps(m, xr + i), ai = _mm512_maskz_loadu_ps(m, xi + i);
+		__m512 br = _mm512_maskz_loadu_ps(m, hr + i), bi = _mm512_maskz_loadu_ps(m, hi + i);
+		_mm512_mask_storeu_ps(yr + i, m, _mm512_fnmadd_ps(ai, bi, _mm512_fmadd_ps(ar, br, _mm512_maskz_loadu_ps(m, yr + i))));
+		_mm512_mask_storeu_ps(yi + i, m, _mm512_fmadd_ps(ai, br, _mm512_fmadd_ps(ar, bi, _mm512_maskz_loadu_ps(m, yi + i))));
+	}
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i pack_avx512(__m512 v) {
+	__m512i r = _mm512_cvttps_epi32(_mm512_mul_ps(v, _mm512_set1_ps(2147483648.0f)));
+
+	return _mm512_mask_xor_epi32(r, _mm512_cmp_ps_mask(v, _mm512_set1_ps(1.0f), _CMP_GE_OQ), r, _mm512_set1_epi32(-1));
+}
+
+// 16 samples a step, the tail is the same step under a mask. 24 bit bytes are read
+// and written under a byte mask, so nothing past the last sample is touched.
+__attribute__((target("avx512f,avx512bw")))
+static void load_avx512(float *out, const void *in, int64_t n, int32_t format) {
+	const uint8_t *b = (const uint8_t*)in;
+	const __m512 scale = _mm512_set1_ps(1.0f / 2147483648.0f);
+	const __m512i spread = _mm512_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6, 6, 7, 8, 9, 9, 10, 11, 12);
+	const __m512i shuf = _mm512_broadcast_i32x4(_mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11));
+	const __m512 div = _mm512_set1_ps(127.0f), one = _mm512_set1_ps(1.0f), div16 = _mm512_set1_ps(1.0f / 32768.0f);
+	int64_t i;
+
+	if (format != SWS_DSP_U8 && format != SWS_DSP_S16 && format != SWS_DSP_S24 && format != SWS_DSP_S32) {
+		memcpy(out, in, n * sizeof(float));
+		return;
+	}
+	for (i = 0; i < n; i += 16)
+	{
+		int32_t left = (n - i < 16) ? n - i : 16;
+		__mmask16 m = (__mmask16)((1u << left) - 1);
+		__m512 v;
+
+		if (format == SWS_DSP_U8)
+			v = _mm512_sub_ps(_mm512_div_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm512_castsi512_si128(_mm512_maskz_loadu_epi8(m, b + i)))), div), one);
+		else if (format == SWS_DSP_S16)
+			v = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(_mm512_castsi512_si256(_mm512_maskz_loadu_epi16(m, (const int16_t*)in + i)))), div16);
+		else if (format == SWS_DSP_S24) {
+			__m512i x = _mm512_maskz_loadu_epi8((__mmask64)((1ull << (left * 3)) - 1), b + i * 3);
+
+			v = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_shuffle_epi8(_mm512_permutexvar_epi32(spread, x), shuf)), scale);
+		} else
+			v = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_maskz_loadu_epi32(m, b + i * 4)), scale);
+		_mm512_mask_storeu_ps(out + i, m, v);
+	}
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void store_avx512(void *out, const float *in, int64_t n, int32_t format) {
+	uint8_t *b = (uint8_t*)out;
+	const __m512i shuf = _mm512_broadcast_i32x4(_mm_setr_epi8(1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1));
+	const __m512i gather = _mm512_setr_epi32(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 15, 15, 15, 15);
+	const __m512 one = _mm512_set1_ps(1.0f), mul8 = _mm512_set1_ps(127.5f), mul16 = _mm512_set1_ps(32767.0f);
+	const __m512 lo8 = _mm512_setzero_ps(), hi8 = _mm512_set1_ps(255.0f);
+	const __m512 lo16 = _mm512_set1_ps(-32768.0f), hi16 = _mm512_set1_ps(32767.0f);
+	int64_t i;
+
+	if (format != SWS_DSP_U8 && format != SWS_DSP_S16 && format != SWS_DSP_S24 && format != SWS_DSP_S32) {
+		memcpy(out, in, n * sizeof(float));
+		return;
+	}
+	for (i = 0; i < n; i += 16)
+	{
+		int32_t left = (n - i < 16) ? n - i : 16;
+		__mmask16 m = (__mmask16)((1u << left) - 1);
+		__m512 v = _mm512_maskz_loadu_ps(m, in + i);
+
+		if (format == SWS_DSP_U8) {
+			v = _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(_mm512_add_ps(v, one), mul8), lo8), hi8);
+			_mm512_mask_storeu_epi8(b + i, m, _mm512_castsi128_si512(_mm512_cvtepi32_epi8(_mm512_cvttps_epi32(v))));
+		} else if (format == SWS_DSP_S16) {
+			v = _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(v, mul16), lo16), hi16);
+			_mm512_mask_storeu_epi16((int16_t*)out + i, m, _mm512_castsi256_si512(_mm512_cvtepi32_epi16(_mm512_cvttps_epi32(v))));
+		} else if (format == SWS_DSP_S24) {
+			__m512i x = _mm512_permutexvar_epi32(gather, _mm512_shuffle_epi8(pack_avx512(v), shuf));
+
+			_mm512_mask_storeu_epi8(b + i * 3, (__mmask64)((1ull << (left * 3)) - 1), x);
+		} else
+			_mm512_mask_storeu_epi32(b + i * 4, m, pack_avx512(v));
+	}
+}
+
+static const swsDsp dspAvx512 = { SWS_DSP_AVX512, "avx512", dot1_avx512, dot2_avx512, dot1i_avx512, dot2i_avx512,
+									lerp_avx512, lerp16_avx512, butterfly_avx512, cmac_avx512, load_avx512, store_avx512 };
+
+#endif
+
+// ******************************************************************************
+// runtime selection
+
+const swsDsp* swsDspLevel(int32_t level) {
+	if (level == SWS_DSP_SCALAR)
+		return &dspScalar;
+#ifdef SWS_DSP_X86
+	__builtin_cpu_init();
+	if (level == SWS_DSP_SSE2 && __builtin_cpu_supports("sse2"))
+		return &dspSse2;
+	if (level == SWS_DSP_AVX2 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")
+		&& __builtin_cpu_supports("f16c"))
+		return &dspAvx2;
+	if (level == SWS_DSP_AVX512 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+		return &dspAvx512;
+#endif
+	return NULL;
+}
+
+const swsDsp* swsDspBest(void) {
+	int32_t level;
+
+	for (level = SWS_DSP_AVX512; level > SWS_DSP_SCALAR; level--)
+	{
+		const swsDsp *dsp = swsDspLevel(level);
+		if (dsp != NULL)
+			return dsp;
+	}
+
+	return &dspScalar;
+}
+
+// ******************************************************************************
+// fp16 tables
+
+static uint16_t float_to_half(float f) {
+	uint32_t x, sign, mant, h, rem, half;
+	int32_t exp, shift;
+
+	memcpy(&x, &f, sizeof(x));
+	sign = (x >> 16) & 0x8000;
+	exp = (int32_t)((x >> 23) & 0xff) - 127 + 15;
+	mant = x & 0x7fffff;
+
+	if (((x >> 23) & 0xff) == 0xff)
+		return sign | 0x7c00 | (mant ? 0x200 : 0);
+	if (exp >= 31)
+		return sign | 0x7c00;
+	if (exp <= 0) {
+		// subnormal, the implicit bit shifted into the mantissa
+		if (exp < -10)
+			return sign;
+		mant |= 0x800000;
+		shift = 14 - exp;
+		h = mant >> shift;
+		rem = mant & ((1u << shift) - 1);
+		half = 1u << (shift - 1);
+	} else {
+		h = ((uint32_t)exp << 10) | (mant >> 13);
+		rem = mant & 0x1fff;
+		half = 0x1000;
+	}
+	// a carry out of the mantissa correctly bumps the exponent
+	if (rem > half || (rem == half && (h & 1)))
+		h++;
+	return sign | h;
+}
+
+void swsDspToHalf(uint16_t *out, const float *in, int32_t n) {
+	int32_t i;
+
+	for (i = 0; i < n; i++)
+		out[i] = float_to_half(in[i]);
+}
+
+void swsDspFromHalf(float *out, const uint16_t *in, int32_t n) {
+	int32_t i;
+
+	for (i = 0; i < n; i++)
+		out[i] = half_to_float(in[i]);
+}
@@ -0,0 +1,65 @@
+/*
+	swsdsp.h
+
+	Filter dot product and sample format kernels for the resampler, in plain C and hand vectorized
+	SSE2, AVX2+FMA and AVX-512 versions picked at runtime from CPUID
+
+	muragami, muragami@wishray.com, Jason A. Petrasko 2024
+	MIT license: https://opensource.org/license/mit/
+*/
+
+#ifndef SWSDSP_H
+#define SWSDSP_H
+
+#include <stdint.h>
+
+#define SWS_DSP_SCALAR		0
+#define SWS_DSP_SSE2		1
+#define SWS_DSP_AVX2		2
+#define SWS_DSP_AVX512		3
+
+// sample formats for load and store, the same codes as wavSound.bitsPerSample
+#define SWS_DSP_U8			8
+#define SWS_DSP_S16			16
+#define SWS_DSP_F32			32
+#define SWS_DSP_S24			(0x100 | 24)
+#define SWS_DSP_S32			(0x100 | 32)
+
+typedef struct _swsDsp {
+	int32_t level;
+	const char *name;
+	// returns sum(x[i] * h[i]) over n taps
+	float (*dot1)(const float *x, const float *h, int32_t n);
+	// x is interleaved stereo, adds the left / right sums into out[0] and out[1]
+	void (*dot2)(const float *x, const float *h, int32_t n, float *out);
+	// fixed point sum(x[i] * h[i]), exact as long as sum |h[i]| * 32768 < 2^31, so
+	// every level returns the same value
+	int32_t (*dot1i)(const int16_t *x, const int16_t *h, int32_t n);
+	// interleaved stereo, the left / right sums go to out[0] and out[1]
+	void (*dot2i)(const int16_t *x, const int16_t *h, int32_t n, int32_t *out);
+	// h[i] = value[i] + delta[i] * interp, stored back to front when reverse is set
+	void (*lerp)(float *h, const float *value, const float *delta, float interp, int32_t n, int32_t reverse);
+	// same from fp16 tables, widened on load
+	void (*lerp16)(float *h, const uint16_t *value, const uint16_t *delta, float interp, int32_t n, int32_t reverse);
+	// FFT butterfly on split complex arrays, s = a + b and d = (a - b) * (cr + i ci)
+	void (*butterfly)(float *sr, float *si, float *dr, float *di, const float *ar, const float *ai,
+						const float *br, const float *bi, float cr, float ci, int32_t n);
+	// complex multiply accumulate on split arrays, y += x * h
+	void (*cmac)(float *yr, float *yi, const float *xr, const float *xi, const float *hr, const float *hi, int32_t n);
+	// n samples to float in -1..1, 8 bit as u / 127 - 1, 16 bit as s / 32768 and packed
+	// 24 / 32 bit as their top aligned int32 / 2^31
+	void (*load)(float *out, const void *in, int64_t n, int32_t format);
+	// and back, 8 bit as (f + 1) * 127.5, 16 bit as f * 32767 and packed as f * 2^31,
+	// truncated toward zero and clamped to the format's range
+	void (*store)(void *out, const float *in, int64_t n, int32_t format);
+} swsDsp;
+
+// the fastest kernels this cpu runs
+const swsDsp* swsDspBest(void);
+// a specific level, NULL if this cpu (or build) can't run it
+const swsDsp* swsDspLevel(int32_t level);
+// IEEE fp16 with round to nearest even, for building the tables lerp16 reads
+void swsDspToHalf(uint16_t *out, const float *in, int32_t n);
+void swsDspFromHalf(float *out, const uint16_t *in, int32_t n);
+
+#endif
@@ -0,0 +1,241 @@
+/*
+	swsfft.c
+
+	Small self contained real FFT for the overlap-save filter stages. A radix-2
+	Stockham complex FFT of half the length, on split real / imaginary arrays so
+	the butterflies are plain loops over contiguous floats, plus the usual pass
+	that turns it into a real transform.
+
+	muragami, muragami@wishray.com, Jason A. Petrasko 2024
+	MIT license: https://opensource.org/license/mit/
+*/
+
+#include "swsfft.h"
+#include <math.h>
+#include <memory.h>
+#include <stdlib.h>
+
+#ifndef M_PI
+#define M_PI   3.14159265358979323846
+#endif
+
+// the work arrays are staggered by this many floats, power of two apart they
+// alias in the cache and the store buffer and every pass stalls
+#define FFT_PAD		24
+
+struct _swsFft {
+	const swsDsp *dsp;
+	int32_t n;
+	int32_t half;
+	// exp(-2 pi i k / n) for k < n / 2, the complex FFT uses the even ones
+	float *twr;
+	float *twi;
+};
+
+swsFft* swsFftCreate(int32_t n, const swsDsp *dsp) {
+	swsFft *fft;
+	int32_t k;
+
+	if (n < 4 || (n & (n - 1))) return NULL;
+	fft = malloc(sizeof(swsFft));
+	if (fft == NULL) return NULL;
+	fft->dsp = dsp;
+	fft->n = n;
+	fft->half = n / 2;
+	fft->twr = malloc(sizeof(float) * fft->half);
+	fft->twi = malloc(sizeof(float) * fft->half);
+	if (fft->twr == NULL || fft->twi == NULL) {
+		swsFftFree(fft);
+		return NULL;
+	}
+	for (k = 0; k < fft->half; k++)
+	{
+		fft->twr[k] = cos(2.0 * M_PI * k / n);
+		fft->twi[k] = -sin(2.0 * M_PI * k / n);
+	}
+	return fft;
+}
+
+void swsFftFree(swsFft *fft) {
+	if (fft == NULL) return;
+	free(fft->twr);
+	free(fft->twi);
+	free(fft);
+}
+
+int32_t swsFftWorkSize(int32_t n) {
+	return n * 2 + FFT_PAD * 4;
+}
+
+// forward complex FFT of n / 2 points in place on re, im. each pass reads one
+// pair of arrays and writes the other, wr and wi are the second pair.
+static void fft_complex(const swsFft *fft, float *re, float *im, float *wr, float *wi) {
+	const int32_t m = fft->half;
+	float *xr = re, *xi = im, *yr = wr, *yi = wi, *t;
+	int32_t n, s, p, q;
+
+	for (n = m, s = 1; n > 1; n >>= 1, s <<= 1)
+	{
+		int32_t h = n >> 1;
+
+		if (s == 1) {
+			// first pass, one butterfly per twiddle so run along p instead
+			for (p = 0; p < h; p++)
+			{
+				float ar = xr[p], ai = xi[p], br = xr[p + h], bi = xi[p + h];
+				float dr = ar - br, di = ai - bi;
+				float cr = fft->twr[p * 2], ci = fft->twi[p * 2];
+
+				yr[p * 2] = ar + br;
+				yi[p * 2] = ai + bi;
+				yr[p * 2 + 1] = dr * cr - di * ci;
+				yi[p * 2 + 1] = dr * ci + di * cr;
+			}
+		} else if (s >= 8) {
+			// long runs of one twiddle, the vector kernels take those
+			for (p = 0; p < h; p++)
+				fft->dsp->butterfly(yr + s * p * 2, yi + s * p * 2, yr + s * p * 2 + s, yi + s * p * 2 + s,
+								xr + s * p, xi + s * p, xr + s * (p + h), xi + s * (p + h),
+								fft->twr[p * s * 2], fft->twi[p * s * 2], s);
+		} else {
+			for (p = 0; p < h; p++)
+			{
+				const float *ar = xr + s * p, *ai = xi + s * p;
+				const float *br = xr + s * (p + h), *bi = xi + s * (p + h);
+				float *sr = yr + s * p * 2, *si = yi + s * p * 2;
+				float *dr = sr + s, *di = si + s;
+				float cr = fft->twr[p * s * 2], ci = fft->twi[p * s * 2];
+
+				for (q = 0; q < s; q++)
+				{
+					float tr = ar[q] - br[q], ti = ai[q] - bi[q];
+
+					sr[q] = ar[q] + br[q];
+					si[q] = ai[q] + bi[q];
+					dr[q] = tr * cr - ti * ci;
+					di[q] = tr * ci + ti * cr;
+				}
+			}
+		}
+
+		t = xr; xr = yr; yr = t;
+		t = xi; xi = yi; yi = t;
+	}
+
+	if (xr != re) {
+		memcpy(re, xr, sizeof(float) * m);
+		memcpy(im, xi, sizeof(float) * m);
+	}
+}
+
+void swsFftForward(const swsFft *fft, const float *x, float *re, float *im, float *work) {
+	const int32_t m = fft->half;
+	float *zr = work, *zi = work + m + FFT_PAD;
+	int32_t k;
+
+	// even samples as the real part, odd as the imaginary
+	for (k = 0; k < m; k++)
+	{
+		zr[k] = x[k * 2];
+		zi[k] = x[k * 2 + 1];
+	}
+	fft_complex(fft, zr, zi, work + (m + FFT_PAD) * 2, work + (m + FFT_PAD) * 3);
+
+	re[0] = zr[0] + zi[0];
+	im[0] = 0.0f;
+	re[m] = zr[0] - zi[0];
+	im[m] = 0.0f;
+	for (k = 1; k < m; k++)
+	{
+		// even and odd halves of the spectrum, then X[k] = E + W^k O
+		float er = (zr[k] + zr[m - k]) * 0.5f, ei = (zi[k] - zi[m - k]) * 0.5f;
+		float or = (zi[k] + zi[m - k]) * 0.5f, oi = (zr[m - k] - zr[k]) * 0.5f;
+
+		re[k] = er + or * fft->twr[k] - oi * fft->twi[k];
+		im[k] = ei + or * fft->twi[k] + oi * fft->twr[k];
+	}
+}
+
+void swsFftInverse(const swsFft *fft, const float *re, const float *im, float *x, float *work) {
+	const int32_t m = fft->half;
+	float *zr = work, *zi = work + m + FFT_PAD;
+	int32_t k;
+
+	// rebuild the packed half length spectrum, conjugated so the forward complex
+	// FFT does the inverse
+	for (k = 0; k < m; k++)
+	{
+		float er = re[k] + re[m - k], ei = im[k] - im[m - k];
+		float dr = re[k] - re[m - k], di = im[k] + im[m - k];
+		float or = dr * fft->twr[k] + di * fft->twi[k], oi = di * fft->twr[k] - dr * fft->twi[k];
+
+		zr[k] = er - oi;
+		zi[k] = -(ei + or);
+	}
+	fft_complex(fft, zr, zi, work + (m + FFT_PAD) * 2, work + (m + FFT_PAD) * 3);
+
+	for (k = 0; k < m; k++)
+	{
+		x[k * 2] = zr[k];
+		x[k * 2 + 1] = -zi[k];
+	}
+}
+
+// in place radix-2, bit reversal then butterflies over one table of twiddles. the
+// table steps by a rotation reseeded exactly every few entries, so even millions of
+// points keep double precision without a sin() and cos() per twiddle.
+int32_t swsFftComplexD(double *re, double *im, int32_t n, int32_t inverse) {
+	const double step = (inverse ? 2.0 : -2.0) * M_PI / n;
+	const double sr = cos(step), si = sin(step);
+	double *twr = malloc(sizeof(double) * (n / 2 + 1) * 2);
+	double *twi = twr + n / 2 + 1;
+	double t;
+	int32_t i, j, k, len, bit;
+
+	if (twr == NULL) return 0;
+	for (k = 0; k < n / 2; k++)
+	{
+		if ((k & 63) == 0) {
+			twr[k] = cos(step * k);
+			twi[k] = sin(step * k);
+		} else {
+			twr[k] = twr[k - 1] * sr - twi[k - 1] * si;
+			twi[k] = twr[k - 1] * si + twi[k - 1] * sr;
+		}
+	}
+	for (i = 1, j = 0; i < n; i++)
+	{
+		for (bit = n >> 1; j & bit; bit >>= 1)
+			j ^= bit;
+		j |= bit;
+		if (i < j) {
+			t = re[i];
+			re[i] = re[j];
+			re[j] = t;
+			t = im[i];
+			im[i] = im[j];
+			im[j] = t;
+		}
+	}
+	for (len = 2; len <= n; len <<= 1)
+	{
+		const int32_t half = len / 2, stride = n / len;
+
+		for (i = 0; i < n; i += len)
+		{
+			for (k = 0; k < half; k++)
+			{
+				const double wr = twr[k * stride], wi = twi[k * stride];
+				double xr = re[i + k + half] * wr - im[i + k + half] * wi;
+				double xi = re[i + k + half] * wi + im[i + k + half] * wr;
+
+				re[i + k + half] = re[i + k] - xr;
+				im[i + k + half] = im[i + k] - xi;
+				re[i + k] += xr;
+				im[i + k] += xi;
+			}
+		}
+	}
+	free(twr);
+	return 1;
+}
@@ -0,0 +1,33 @@
+/*
+	swsfft.h
+
+	Small self contained real FFT for the overlap-save filter stages
+
+	muragami, muragami@wishray.com, Jason A. Petrasko 2024
+	MIT license: https://opensource.org/license/mit/
+*/
+
+#ifndef SWSFFT_H
+#define SWSFFT_H
+
+#include "swsdsp.h"
+#include <stdint.h>
+
+typedef struct _swsFft swsFft;
+
+// n is a power of two, at least 4, the butterflies run on dsp. read only once
+// created, threads can share one.
+swsFft* swsFftCreate(int32_t n, const swsDsp *dsp);
+void swsFftFree(swsFft *fft);
+// floats of scratch a forward or inverse call needs
+int32_t swsFftWorkSize(int32_t n);
+// n real samples to n/2 + 1 bins, split into re and im
+void swsFftForward(const swsFft *fft, const float *x, float *re, float *im, float *work);
+// n/2 + 1 bins back to n real samples, unscaled: forward then inverse gives n * x
+void swsFftInverse(const swsFft *fft, const float *re, const float *im, float *x, float *work);
+// complex, in place and in double, for filter design where a table is built once and
+// float isn't enough. not on the dsp and no plan, n a power of two, unscaled as
+// above. 0 when it couldn't allocate its twiddles.
+int32_t swsFftComplexD(double *re, double *im, int32_t n, int32_t inverse);
+
+#endif